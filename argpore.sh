@@ -23,6 +23,8 @@ arguments:
 			input_taxa.tab
 			input_arg.tab
 			input_arg.w.taxa.tab
+			input_arg.subtype.tab
+			input_arg.type.tab
 		To change the prefix of output files, specify the suffix name using this option
 
 	-t 	number of threads used for lastal, default t=1
@@ -32,6 +34,8 @@ output files:
 	input_arg.tab	nanopore reads with valid ARGs hits
 	input_taxa.tab	nanopore reads with valid taxonomy assignment
 	input_arg.w.taxa.tab	ARGs-containing nanopore reads with valid taxonomy assignment
+	input_arg.subtype.tab	number of ARG hits of each subtype
+	input_arg.type.tab	number of ARG hits of each type
 
 example usage: argpore -f 1D.fa 
 EOF
@@ -131,45 +135,23 @@ shift "$((OPTIND-1))"
 ########
 
 echo "start argpore @ `date +"%Y-%m-%d %T"`"
-echo "search agaisnt SARG-nt with similarity cutoff $Simcutoff and alignment length cutoff $Lencuoff using $N_threads threads"
+echo "search agaisnt SARG-nt and MetaPhlan 2.0 markergene database with similarity cutoff $Simcutoff and alignment length cutoff $Lencuoff using $N_threads threads"
 
+# one pass over the reads: SARG-nt results go to stdout, and markergene
+# results (with -b 1 -q 2, and the same --filter) go to the --database
+# output file
+${DIR}/last-744/src/lastal -s 2 -T 0 -Q 0 -a 1 -P $N_threads -f BlastTab+ --filter="identity>=$Simcutoff" --database="${DIR}/markers.lastindex ./tmp/argpore_${nowt}_${Input_fa}_tmp.blast3 -b 1 -q 2" ${DIR}/ARGs_database_renamed.fnt.subset.lastindex $Input_fa > ./tmp/argpore_${nowt}_${Input_fa}_tmp.blast
+echo "finish searching againt SARG-nt and markergene database"
 
-${DIR}/last-744/src/lastal -s 2 -T 0 -Q 0 -a 1 -P $N_threads -f BlastTab ${DIR}/ARGs_database_renamed.fnt.subset.lastindex $Input_fa > ./tmp/argpore_${nowt}_${Input_fa}_tmp.blast
-echo "finish searching againt SARG-nt database"
-echo "parsing SARG-nt results"
-grep -v "#" ./tmp/argpore_${nowt}_${Input_fa}_tmp.blast > ./tmp/argpore_${nowt}_${Input_fa}_tmp.blast.modified
-
-ruby ${DIR}/BlastTab.addlen.rb -s -f ${DIR}/ARGs_database_renamed.fnt.subset < ./tmp/argpore_${nowt}_${Input_fa}_tmp.blast.modified > ./tmp/argpore_${nowt}_${Input_fa}_tmp.blast2
-
-ruby ${DIR}/BlastTab.addlen.rb -f $Input_fa < ./tmp/argpore_${nowt}_${Input_fa}_tmp.blast2 > ./tmp/${Input_fa}_${nowt}_sarg.tab
-
-echo "finish parsing SARG-nt results"
-
-#################
-# taxonomy profile
-# lastal 1D.fa or 2D.fa agaisnt markers.fasta
-#################
-echo " "
-echo "search agaisnt MetaPhlan 2.0 markergene database with similarity cutoff $Simcutoff and alignment length cutoff $Lencuoff using $N_threads threads"
-
-${DIR}/last-744/src/lastal -s 2 -T 0 -Q 0 -a 1 -b 1 -q 2 -P $N_threads -f BlastTab ${DIR}/markers.lastindex $Input_fa > ./tmp/argpore_${nowt}_${Input_fa}_tmp.blast3
-
-echo "finish searching agaisnt markergene database"
-echo "parsing markergene results"
-grep -v "#" ./tmp/argpore_${nowt}_${Input_fa}_tmp.blast3 > ./tmp/argpore_${nowt}_${Input_fa}_tmp.blast3.modified
-
-ruby ${DIR}/BlastTab.addlen.rb -s -f ${DIR}/markers.fasta < ./tmp/argpore_${nowt}_${Input_fa}_tmp.blast3.modified > ./tmp/argpore_${nowt}_${Input_fa}_tmp.blast4
-
-ruby ${DIR}/BlastTab.addlen.rb -f $Input_fa < ./tmp/argpore_${nowt}_${Input_fa}_tmp.blast4 > ./tmp/${Input_fa}_${nowt}_marker.tab
-
-echo "finish parsing markergene results"
-
-
-# STEP Three: summary in nanopore.summary.R
-echo " " 
-echo "start parsing results in R"
-Rscript ${DIR}/argpore.R $Input_fa $Simcutoff $Lencuoff $Output $nowt $DIR --save
+# the taxonomy of the marker genes, as a tab-separated table
+if [ ! -e ${DIR}/taxa.info.tab ]
+then
+	Rscript -e "load('${DIR}/taxa.info.RData'); write.table(taxa.info[,c('subject','kindom','phylum','class','order','family','genus','species','sub.species')], '${DIR}/taxa.info.tab', quote=F, row.names=F, sep='\t')"
+fi
 
+echo "parsing SARG-nt and markergene results"
+${DIR}/last-744/src/argpore-tabulate -s $Simcutoff -l $Lencuoff -a ${DIR}/ARGs_database_renamed.fnt.subset_subtype.name -t ${DIR}/taxa.info.tab -o $Output $Input_fa ./tmp/argpore_${nowt}_${Input_fa}_tmp.blast ./tmp/argpore_${nowt}_${Input_fa}_tmp.blast3
+echo "finish parsing results"
 
 echo ""
 echo "finish argpore @ `date +"%Y-%m-%d %T"`"
@@ -79,7 +79,9 @@ void Alignment::makeXdrop( Centroid& centroid,
                            const TwoQualityScoreMatrix& sm2qual,
                            const uchar* qual1, const uchar* qual2,
 			   const Alphabet& alph, AlignmentExtras& extras,
-			   double gamma, int outputType ){
+			   double gamma, int outputType,
+			   GappedExtension* savedExtensions,
+			   const GappedExtension* reusedExtensions ){
   score = seed.score;
   if( outputType > 3 ) extras.fullScore = seed.score;
 
@@ -101,7 +103,7 @@ void Alignment::makeXdrop( Centroid& centroid,
 	  seq1, seq2, seed.beg1(), seed.beg2(), false, globality,
 	  scoreMatrix, smMax, maxDrop, gap, frameshiftCost,
 	  frameSize, pssm2, sm2qual, qual1, qual2, alph,
-	  extras, gamma, outputType );
+	  extras, gamma, outputType, savedExtensions, reusedExtensions );
 
   if( score == -INF ) return;  // maybe unnecessary?
 
@@ -121,7 +123,9 @@ void Alignment::makeXdrop( Centroid& centroid,
 	  seq1, seq2, seed.end1(), seed.end2(), true, globality,
 	  scoreMatrix, smMax, maxDrop, gap, frameshiftCost,
 	  frameSize, pssm2, sm2qual, qual1, qual2, alph,
-	  extras, gamma, outputType );
+	  extras, gamma, outputType,
+	  savedExtensions ? savedExtensions + 1 : 0,
+	  reusedExtensions ? reusedExtensions + 1 : 0 );
 
   if( score == -INF ) return;  // maybe unnecessary?
 
@@ -276,7 +280,9 @@ void Alignment::extend( std::vector< SegmentPair >& chunks,
                         const TwoQualityScoreMatrix& sm2qual,
                         const uchar* qual1, const uchar* qual2,
 			const Alphabet& alph, AlignmentExtras& extras,
-			double gamma, int outputType ){
+			double gamma, int outputType,
+			GappedExtension* savedExtension,
+			const GappedExtension* reusedExtension ){
   GappedXdropAligner& aligner = centroid.aligner();
 
   if( frameSize ){
@@ -308,8 +314,16 @@ void Alignment::extend( std::vector< SegmentPair >& chunks,
     return;
   }
 
+  size_t oldNumOfChunks = chunks.size();
+
+  if( reusedExtension ){
+    assert( !isGreedy );
+    aligner.setShape( reusedExtension->shape );
+  }
+
   int extensionScore =
-    isGreedy  ? greedyAligner.align( seq1 + start1, seq2 + start2,
+    reusedExtension ? reusedExtension->score
+    : isGreedy  ? greedyAligner.align( seq1 + start1, seq2 + start2,
 				     isForward, sm, maxDrop, alph.size )
     : sm2qual ? aligner.align2qual( seq1 + start1, qual1 + start1,
 				    seq2 + start2, qual2 + start2,
@@ -337,7 +351,10 @@ void Alignment::extend( std::vector< SegmentPair >& chunks,
 
   if( outputType < 5 || outputType == 7 ){  // ordinary max-score alignment
     size_t end1, end2, size;
-    if( isGreedy ){
+    if( reusedExtension ){
+      chunks.insert( chunks.end(), reusedExtension->chunks.begin(),
+		     reusedExtension->chunks.end() );
+    }else if( isGreedy ){
       while( greedyAligner.getNextChunk( end1, end2, size ) )
 	chunks.push_back( SegmentPair( end1 - size, end2 - size, size ) );
     }else{
@@ -349,6 +366,14 @@ void Alignment::extend( std::vector< SegmentPair >& chunks,
     }
   }
 
+  if( savedExtension ){
+    assert( !isGreedy );
+    savedExtension->score = extensionScore;
+    savedExtension->chunks.assign( chunks.begin() + oldNumOfChunks,
+				   chunks.end() );
+    aligner.getShape( savedExtension->shape );
+  }
+
   if( outputType > 3 ){  // calculate match probabilities
     assert( !isGreedy );
     assert( !sm2qual );
@@ -367,7 +392,7 @@ void Alignment::extend( std::vector< SegmentPair >& chunks,
     if( outputType == 7 ){
       ExpectedCount ec;
       centroid.computeExpectedCounts( seq1, seq2, start1, start2,
-				      isForward, gap, ec );
+				      isForward, globality, gap, ec );
       addExpectedCounts( &extras.expectedCounts[0], ec, alph );
     }
   }
@@ -6,6 +6,7 @@
 #define ALIGNMENT_HH
 #include "ScoreMatrixRow.hh"
 #include "SegmentPair.hh"
+#include "TextArena.hh"
 #include <stddef.h>  // size_t
 #include <string>
 #include <vector>
@@ -32,7 +33,7 @@ struct AlignmentText {
   int score;
   SegmentPair::indexT alnSize;
   SegmentPair::indexT matches;
-  char *text;  // seems to be a bit faster than std::vector<char>
+  char *text;  // in a TextArena: seems to be faster than std::vector<char>
 
   AlignmentText() {}
 
@@ -68,6 +69,14 @@ struct AlignmentExtras {
   AlignmentExtras() : fullScore(0) {}
 };
 
+struct GappedExtension {
+  // One side's gapped X-drop extension of an Alignment, kept so that
+  // it can be re-used without redoing the X-drop dynamic programming.
+  int score;
+  std::vector<SegmentPair> chunks;  // relative to the start of extension
+  std::vector<unsigned> shape;  // from GappedXdropAligner::getShape
+};
+
 struct Alignment{
   // make a single-block alignment:
   void fromSegmentPair( const SegmentPair& sp );
@@ -77,6 +86,10 @@ struct Alignment{
   // Alignment might not be "optimal" (see below).
   // If outputType > 3: calculates match probabilities.
   // If outputType > 4: does gamma-centroid alignment.
+  // If savedExtensions isn't null: saves the reverse and forward
+  // extensions in savedExtensions[0] and [1].  If reusedExtensions
+  // isn't null: uses these saved extensions (from the same seed and
+  // parameters) instead of redoing them.
   void makeXdrop( Centroid& centroid,
 		  GreedyXdropAligner& greedyAligner, bool isGreedy,
 		  const uchar* seq1, const uchar* seq2, int globality,
@@ -87,7 +100,9 @@ struct Alignment{
                   const TwoQualityScoreMatrix& sm2qual,
                   const uchar* qual1, const uchar* qual2,
 		  const Alphabet& alph, AlignmentExtras& extras,
-		  double gamma = 0, int outputType = 0 );
+		  double gamma = 0, int outputType = 0,
+		  GappedExtension* savedExtensions = 0,
+		  const GappedExtension* reusedExtensions = 0 );
 
   // Check that the Alignment has no prefix with score <= 0, no suffix
   // with score <= 0, and no sub-segment with score < -maxDrop.
@@ -114,7 +129,7 @@ struct Alignment{
 		      size_t seqNum2, char strand, const uchar* seqData2,
 		      bool isTranslated, const Alphabet& alph,
 		      const LastEvaluer& evaluer, int format,
-		      const AlignmentExtras& extras) const;
+		      const AlignmentExtras& extras, TextArena& arena) const;
 
   // data:
   std::vector<SegmentPair> blocks;  // the gapless blocks of the alignment
@@ -140,18 +155,22 @@ struct Alignment{
                const TwoQualityScoreMatrix& sm2qual,
                const uchar* qual1, const uchar* qual2,
 	       const Alphabet& alph, AlignmentExtras& extras,
-	       double gamma, int outputType );
+	       double gamma, int outputType,
+	       GappedExtension* savedExtension,
+	       const GappedExtension* reusedExtension );
 
   AlignmentText writeTab(const MultiSequence& seq1, const MultiSequence& seq2,
 			 size_t seqNum2, char strand, bool isTranslated,
 			 const LastEvaluer& evaluer,
-			 const AlignmentExtras& extras) const;
+			 const AlignmentExtras& extras,
+			 TextArena& arena) const;
 
   AlignmentText writeMaf(const MultiSequence& seq1, const MultiSequence& seq2,
 			 size_t seqNum2, char strand, const uchar* seqData2,
 			 bool isTranslated, const Alphabet& alph,
 			 const LastEvaluer& evaluer,
-			 const AlignmentExtras& extras) const;
+			 const AlignmentExtras& extras,
+			 TextArena& arena) const;
 
   AlignmentText writeBlastTab(const MultiSequence& seq1,
 			      const MultiSequence& seq2,
@@ -159,10 +178,14 @@ struct Alignment{
 			      const uchar* seqData2,
 			      bool isTranslated, const Alphabet& alph,
 			      const LastEvaluer& evaluer,
-			      bool isExtraColumns) const;
+			      bool isExtraColumns, TextArena& arena) const;
 
   size_t numColumns( size_t frameSize ) const;
 
+  // count the aligned pairs of identical letters (ignoring case):
+  size_t matchCount( const uchar* seq1, const uchar* seq2,
+		     const uchar* numbersToUppercase ) const;
+
   char* writeTopSeq( const uchar* seq, const Alphabet& alph,
 		     size_t qualsPerBase, size_t frameSize, char* dest ) const;
 
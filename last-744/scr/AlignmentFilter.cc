@@ -0,0 +1,112 @@
+// Copyright 2026 The ARGpore authors
+
+#include "AlignmentFilter.hh"
+#include "Alignment.hh"
+#include "Alphabet.hh"
+#include "GeneticCode.hh"
+#include "LastEvaluer.hh"
+#include "MultiSequence.hh"
+#include <cstdlib>  // strtod
+#include <stdexcept>
+
+#define ERR(x) throw std::runtime_error(x)
+
+using namespace cbrc;
+
+void AlignmentFilter::fromString(const std::string &s) {
+  static const char *names[] =
+    {"identity", "scov", "qcov", "evalue", "bitscore", "score"};
+  const char *delimiters = " \t,";
+  conditions.clear();
+  size_t i = 0;
+  while (true) {
+    i = s.find_first_not_of(delimiters, i);
+    if (i == std::string::npos) break;
+    size_t j = s.find_first_of(delimiters, i);
+    if (j == std::string::npos) j = s.size();
+    std::string word = s.substr(i, j - i);
+    i = j;
+
+    size_t k = word.find_first_of("<>");
+    if (k == std::string::npos) ERR("bad filter condition: " + word);
+    std::string name = word.substr(0, k);
+    Condition c;
+
+    size_t v = 0;
+    while (v < sizeof names / sizeof *names && name != names[v]) ++v;
+    if (v == sizeof names / sizeof *names)
+      ERR("unknown filter variable: " + name);
+    c.variable = static_cast<Variable>(v);
+
+    bool isOrEqual = (word.c_str()[k + 1] == '=');
+    if (word[k] == '<') c.op = isOrEqual ? lessOrEqual : less;
+    else                c.op = isOrEqual ? greaterOrEqual : greater;
+
+    const char *number = word.c_str() + k + 1 + isOrEqual;
+    char *end;
+    c.value = std::strtod(number, &end);
+    if (end == number || *end) ERR("bad filter condition: " + word);
+
+    conditions.push_back(c);
+  }
+}
+
+bool AlignmentFilter::isUsingEvaluer() const {
+  for (size_t i = 0; i < conditions.size(); ++i) {
+    Variable v = conditions[i].variable;
+    if (v == evalue || v == bitscore) return true;
+  }
+  return false;
+}
+
+bool AlignmentFilter::isTrue(const Condition &c, double x) {
+  switch (c.op) {
+  case less:           return x <  c.value;
+  case lessOrEqual:    return x <= c.value;
+  case greater:        return x >  c.value;
+  case greaterOrEqual: return x >= c.value;
+  }
+  return false;
+}
+
+bool AlignmentFilter::isPass(const Alignment &aln,
+			     const MultiSequence &seq1,
+			     const MultiSequence &seq2,
+			     size_t seqNum2, const uchar *seqData2,
+			     bool isTranslated, const Alphabet &alph,
+			     const LastEvaluer &evaluer) const {
+  size_t seqNum1 = seq1.whichSequence(aln.beg1());
+  size_t frameSize2 = isTranslated ? (seq2.padLen(seqNum2) / 3) : 0;
+  size_t seqLen2 = seq2.seqLen(seqNum2);
+
+  for (size_t i = 0; i < conditions.size(); ++i) {
+    const Condition &c = conditions[i];
+    double x = 0;
+    switch (c.variable) {
+    case identity:
+      x = 100.0 * aln.matchCount(seq1.seqReader(), seqData2,
+				 alph.numbersToUppercase)
+	/ aln.numColumns(frameSize2);
+      break;
+    case scov:
+      x = 1.0 * (aln.end1() - aln.beg1()) / seq1.seqLen(seqNum1);
+      break;
+    case qcov:
+      x = 1.0 * (aaToDna(aln.end2(), frameSize2) -
+		 aaToDna(aln.beg2(), frameSize2)) / seqLen2;
+      break;
+    case evalue:
+      x = evaluer.area(aln.score, seqLen2) * evaluer.evaluePerArea(aln.score);
+      break;
+    case bitscore:
+      x = evaluer.bitScore(aln.score);
+      break;
+    case score:
+      x = aln.score;
+      break;
+    }
+    if (!isTrue(c, x)) return false;
+  }
+
+  return true;
+}
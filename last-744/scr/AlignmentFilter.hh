@@ -0,0 +1,61 @@
+// Copyright 2026 The ARGpore authors
+
+// This class holds criteria for keeping alignments, such as
+// "identity>80 scov>0.7".  They are checked before the alignment text
+// is made, so rejected alignments are never formatted.
+
+#ifndef ALIGNMENTFILTER_HH
+#define ALIGNMENTFILTER_HH
+
+#include <stddef.h>  // size_t
+#include <string>
+#include <vector>
+
+namespace cbrc{
+
+typedef unsigned char uchar;
+
+struct Alignment;
+struct Alphabet;
+class LastEvaluer;
+class MultiSequence;
+
+class AlignmentFilter {
+public:
+  // Set the criteria from a string of conditions, separated by
+  // spaces or commas, all of which must hold.  Each condition is
+  // NAME OPERATOR NUMBER, e.g. "evalue<=1e-10".  The names are:
+  // identity (percent identity, as in BlastTab), scov (fraction of the
+  // subject/reference sequence that is aligned), qcov (fraction of the
+  // query that is aligned), evalue, bitscore, score.
+  void fromString(const std::string &s);
+
+  bool empty() const { return conditions.empty(); }
+
+  // Does any condition need E-value parameters?
+  bool isUsingEvaluer() const;
+
+  // Does the alignment meet all the conditions?
+  bool isPass(const Alignment &aln,
+	      const MultiSequence &seq1, const MultiSequence &seq2,
+	      size_t seqNum2, const uchar *seqData2,
+	      bool isTranslated, const Alphabet &alph,
+	      const LastEvaluer &evaluer) const;
+
+private:
+  enum Variable { identity, scov, qcov, evalue, bitscore, score };
+  enum Operator { less, lessOrEqual, greater, greaterOrEqual };
+
+  struct Condition {
+    Variable variable;
+    Operator op;
+    double value;
+  };
+
+  std::vector<Condition> conditions;
+
+  static bool isTrue(const Condition &c, double x);
+};
+
+}  // end namespace cbrc
+#endif  // ALIGNMENTFILTER_HH
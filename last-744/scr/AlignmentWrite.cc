@@ -94,18 +94,19 @@ AlignmentText Alignment::write(const MultiSequence& seq1,
 			       const uchar* seqData2,
 			       bool isTranslated, const Alphabet& alph,
 			       const LastEvaluer& evaluer, int format,
-			       const AlignmentExtras& extras) const {
+			       const AlignmentExtras& extras,
+			       TextArena& arena) const {
   assert( !blocks.empty() );
 
   if( format == 'm' )
     return writeMaf( seq1, seq2, seqNum2, strand, seqData2,
-		     isTranslated, alph, evaluer, extras );
+		     isTranslated, alph, evaluer, extras, arena );
   if( format == 't' )
     return writeTab( seq1, seq2, seqNum2, strand,
-		     isTranslated, evaluer, extras );
+		     isTranslated, evaluer, extras, arena );
   else
     return writeBlastTab( seq1, seq2, seqNum2, strand, seqData2,
-			  isTranslated, alph, evaluer, format == 'B' );
+			  isTranslated, alph, evaluer, format == 'B', arena );
 }
 
 static size_t alignedColumnCount(const std::vector<SegmentPair> &blocks) {
@@ -181,7 +182,8 @@ AlignmentText Alignment::writeTab(const MultiSequence& seq1,
 				  size_t seqNum2, char strand,
 				  bool isTranslated,
 				  const LastEvaluer& evaluer,
-				  const AlignmentExtras& extras) const {
+				  const AlignmentExtras& extras,
+				  TextArena& arena) const {
   size_t alnBeg1 = beg1();
   size_t alnEnd1 = end1();
   size_t seqNum1 = seq1.whichSequence(alnBeg1);
@@ -217,7 +219,7 @@ AlignmentText Alignment::writeTab(const MultiSequence& seq1,
     n1.size() + b1.size() + r1.size() + 1 + s1.size() + 5 +
     n2.size() + b2.size() + r2.size() + 1 + s2.size() + 5 + blockLen + tagLen;
 
-  char *text = new char[textLen + 1];
+  char *text = arena.alloc(textLen + 1);
   Writer w(text);
   w << sc << t;
   w << n1 << t << b1 << t << r1 << t << '+'    << t << s1 << t;
@@ -301,7 +303,8 @@ AlignmentText Alignment::writeMaf(const MultiSequence& seq1,
 				  const uchar* seqData2,
 				  bool isTranslated, const Alphabet& alph,
 				  const LastEvaluer& evaluer,
-				  const AlignmentExtras& extras) const {
+				  const AlignmentExtras& extras,
+				  TextArena& arena) const {
   double fullScore = extras.fullScore;
   const std::vector<uchar>& columnAmbiguityCodes = extras.columnAmbiguityCodes;
 
@@ -352,7 +355,7 @@ AlignmentText Alignment::writeMaf(const MultiSequence& seq1,
 
   size_t sLineNum = 2 + isQuals1 + isQuals2 + !columnAmbiguityCodes.empty();
   size_t textLen = aLineLen + sLineLen * sLineNum + cLine.size() + 1;
-  char *text = new char[textLen + 1];
+  char *text = arena.alloc(textLen + 1);
 
   char *dest = std::copy(aLine, aLineEnd, text);
 
@@ -400,7 +403,8 @@ AlignmentText Alignment::writeBlastTab(const MultiSequence& seq1,
 				       const uchar* seqData2,
 				       bool isTranslated, const Alphabet& alph,
 				       const LastEvaluer& evaluer,
-				       bool isExtraColumns) const {
+				       bool isExtraColumns,
+				       TextArena& arena) const {
   size_t alnBeg1 = beg1();
   size_t alnEnd1 = end1();
   size_t seqNum1 = seq1.whichSequence(alnBeg1);
@@ -415,7 +419,7 @@ AlignmentText Alignment::writeBlastTab(const MultiSequence& seq1,
   size_t seqLen2 = seq2.seqLen(seqNum2);
 
   size_t alnSize = numColumns( frameSize2 );
-  size_t matches = matchCount( blocks, seq1.seqReader(), seqData2,
+  size_t matches = matchCount( seq1.seqReader(), seqData2,
 			       alph.numbersToUppercase );
   size_t mismatches = alignedColumnCount(blocks) - matches;
   size_t gapOpens = blocks.size() - 1;
@@ -464,7 +468,7 @@ AlignmentText Alignment::writeBlastTab(const MultiSequence& seq1,
   if (evaluer.isGood()) s += ev.size() + bs.size() + 2;
   if (isExtraColumns)   s += s1.size() + s2.size() + 2;
 
-  char *text = new char[s + 1];
+  char *text = arena.alloc(s + 1);
   Writer w(text);
   const char t = '\t';
   w << n2 << t << n1 << t << mp << t << as << t << mm << t << go << t
@@ -477,6 +481,11 @@ AlignmentText Alignment::writeBlastTab(const MultiSequence& seq1,
 		       alnSize, matches, text);
 }
 
+size_t Alignment::matchCount( const uchar* seq1, const uchar* seq2,
+			      const uchar* numbersToUppercase ) const{
+  return ::matchCount( blocks, seq1, seq2, numbersToUppercase );
+}
+
 size_t Alignment::numColumns( size_t frameSize ) const{
   size_t num = 0;
 
@@ -3,16 +3,21 @@
 
 #include "Centroid.hh"
 #include "GappedXdropAlignerInl.hh"
+#include "simd.hh"
 #include <algorithm>
 #include <cassert>
 #include <cmath> // for exp
-#include <cfloat>   // for DBL_MAX
+#include <cfloat>   // for DBL_MAX, FLT_MAX
 #include <cstdlib>  // for abs
 #include <iomanip>
 
 #define CI(type) std::vector<type>::const_iterator  // added by MCF
 
+#ifdef CENTROID_FLOAT
+static const float DINF = FLT_MAX / 2;
+#else
 static const double DINF = DBL_MAX / 2;
+#endif
 
 namespace{
   double EXP ( double x ) {
@@ -95,9 +100,48 @@ namespace cbrc{
     }
   }
 
+  Centroid::Input
+  Centroid::makeInput( const uchar* seq1, const uchar* seq2,
+		       size_t start1, size_t start2, bool isForward,
+		       int globality,
+		       const GeneralizedAffineGapCosts& gap ) const{
+    Input in;
+    in.seq1 = seq1 + start1;
+    in.seq2 = seq2 + start2;
+    in.pssm = isPssm ? pssmExp2 + start2 : 0;
+    in.isForward = isForward;
+    in.globality = globality;
+    // computeExpectedCounts uses fP, except with a PSSM and affine gaps
+    in.isPair = !isPssm || !gap.isAffine();
+    in.eE = EXP ( - gap.delExtend / T );
+    in.eF = EXP ( - gap.delExist / T );
+    in.eEI = EXP ( - gap.insExtend / T );
+    in.eFI = EXP ( - gap.insExist / T );
+    in.eP = EXP ( - gap.pairExtend / T );
+    assert( gap.insExist == gap.delExist || in.eP <= 0.0 );
+    return in;
+  }
+
   void Centroid::initForwardMatrix(){
     scale.assign ( numAntidiagonals + 2, 1.0 ); // scaling
-    size_t n = xa.scoreEndIndex( numAntidiagonals );
+
+    // Split the antidiagonals into segments, each of which needs at
+    // most maxCells cells, or one antidiagonal
+    segmentBegs.clear();
+    checkpointBegs.clear();
+    size_t checkpointSize = 0;
+    size_t n = 0;
+    for( size_t k = 0; k < numAntidiagonals; ){
+      const size_t base = segmentBase( k );
+      segmentBegs.push_back( k );
+      checkpointBegs.push_back( checkpointSize );
+      checkpointSize += 4 * ( xa.scoreEndIndex( k ) - base );
+      do ++k;
+      while( k < numAntidiagonals && xa.scoreEndIndex( k + 1 ) - base <= maxCells );
+      n = std::max( n, xa.scoreEndIndex( k ) - base );
+    }
+    segmentBegs.push_back( numAntidiagonals );
+    if( segmentBegs.size() > 2 ) fCheckpoints.resize( checkpointSize );
 
     if ( fM.size() < n ) {
       fM.resize( n );
@@ -105,26 +149,65 @@ namespace cbrc{
       fI.resize( n );
       fP.resize( n );
     }
-
-    fM[0] = 1;
   }
 
   void Centroid::initBackwardMatrix(){
-    pp.resize( fM.size() );
+    pp.resize( xa.scoreEndIndex( numAntidiagonals ) );
     mD.assign( numAntidiagonals + 2, 0.0 );
     mI.assign( numAntidiagonals + 2, 0.0 );
     mX1.assign ( numAntidiagonals + 2, 1.0 );
     mX2.assign ( numAntidiagonals + 2, 1.0 );
 
-    size_t n = xa.scoreEndIndex( numAntidiagonals );
-    bM.assign( n, 0.0 );
-    bD.assign( n, 0.0 );
-    bI.assign( n, 0.0 );
-    bP.assign( n, 0.0 );
+    size_t n = fM.size();
+    if ( bM.size() < n ) {
+      bM.resize( n );
+      bD.resize( n );
+      bI.resize( n );
+      bP.resize( n );
+    }
+    if( segmentBegs.size() > 2 ) bCheckpoints.resize( fCheckpoints.size() );
+    segmentUnits.resize( segmentBegs.size() - 1 );
   }
 
   void Centroid::initDecodingMatrix(){
-    X.resize( fM.size() );
+    X.resize( pp.size() );
+  }
+
+  void Centroid::copyCheckpoint( dvec_t& store, dvec_t& w, dvec_t& x,
+				 dvec_t& y, dvec_t& z, size_t slot, size_t s,
+				 bool isToStore ){
+    const size_t k = segmentBegs[ slot ];
+    const size_t beg = segmentBase( k ) - segmentBase( segmentBegs[ s ] );
+    const size_t n = xa.scoreEndIndex( k ) - segmentBase( k );
+    prob_t* c = &store[ checkpointBegs[ slot ] ];
+    dvec_t* matrices[] = { &w, &x, &y, &z };
+    for( int i = 0; i < 4; ++i ){
+      prob_t* m = &( *matrices[ i ] )[ beg ];
+      if( isToStore ) std::copy( m, m + n, c + i * n );
+      else            std::copy( c + i * n, c + i * n + n, m );
+    }
+  }
+
+  void Centroid::initForwardSegment( size_t s ){
+    if( s > 0 ){
+      copyCheckpoint( fCheckpoints, fM, fD, fI, fP, s, s, false );
+    }
+    else{  // the 2 dummy antidiagonals, with 1 cell each
+      fM[0] = 1;
+      fM[1] = fD[0] = fD[1] = fI[0] = fI[1] = fP[0] = fP[1] = 0;
+    }
+  }
+
+  void Centroid::initBackwardSegment( size_t s ){
+    const size_t n =
+      xa.scoreEndIndex( segmentBegs[ s + 1 ] ) - segmentBase( segmentBegs[ s ] );
+    std::fill( bM.begin(), bM.begin() + n, 0.0 );
+    std::fill( bD.begin(), bD.begin() + n, 0.0 );
+    std::fill( bI.begin(), bI.begin() + n, 0.0 );
+    std::fill( bP.begin(), bP.begin() + n, 0.0 );
+    if( s + 2 < segmentBegs.size() ){
+      copyCheckpoint( bCheckpoints, bM, bD, bI, bP, s + 1, s, false );
+    }
   }
 
   void Centroid::updateScore( double score, size_t antiDiagonal, size_t cur ){
@@ -140,142 +223,369 @@ namespace cbrc{
     return expScores[c] <= 0.0;
   }
 
+  void Centroid::getMatchProbs( const Input& in, size_t seq1beg,
+				size_t seq2pos, size_t numCells ){
+    const int globality = in.globality;
+    const ExpMatrixRow* pssm = in.pssm;
+    const int seqIncrement = in.isForward ? 1 : -1;
+    if( matchProbs.size() < numCells ){
+      matchProbs.resize( numCells );
+      edgeFlags.resize( numCells );
+      insProbs.resize( numCells );
+      notProbs2.resize( numCells );
+      replayProbs.resize( numCells );
+    }
+
+    const uchar* s1 = seqPtr( in.seq1, in.isForward, seq1beg );
+
+    if( !isPssm ){
+      const uchar* s2 = seqPtr( in.seq2, in.isForward, seq2pos );
+      for( size_t c = 0; c < numCells; ++c ){
+	matchProbs[ c ] = match_score[ *s1 ][ *s2 ];
+	if( globality ){
+	  edgeFlags[ c ] = ( isDelimiter(*s2, *match_score) ||
+			     isDelimiter(*s1, *match_score) );
+	}
+	s1 += seqIncrement;
+	s2 -= seqIncrement;
+      }
+    }
+    else{
+      const ExpMatrixRow* p2 = seqPtr( pssm, in.isForward, seq2pos );
+      for( size_t c = 0; c < numCells; ++c ){
+	matchProbs[ c ] = ( *p2 )[ *s1 ];
+	if( globality ){
+	  edgeFlags[ c ] = ( isDelimiter(0, *p2) ||
+			     isDelimiter(*s1, *pssm) );
+	}
+	s1 += seqIncrement;
+	p2 -= seqIncrement;
+      }
+    }
+  }
+
+  // Scaled transition probabilities for one antidiagonal
+  template<typename T> struct CellFactors {
+    T scale12, seE, seEI, seP, eF, eFI;
+  };
+
+#ifdef SIMD_DOUBLE_LEN
+  template<typename T> struct SimdType;
+
+  template<> struct SimdType<double> {
+    typedef SimdDouble V;
+    enum { len = SIMD_DOUBLE_LEN };
+  };
+
+  template<> struct SimdType<float> {
+    typedef SimdFloat V;
+    enum { len = SIMD_FLOAT_LEN };
+  };
+#endif
+
+  // Calculate the forward values of the cells in one antidiagonal,
+  // given their match probabilities, and return the sum of their xM
+  // values.  If isGlobal, add the x values of cells next to
+  // delimiters to Z.  If !isPair, fP isn't used.  Each cell's values
+  // are identical with or without SIMD, but the sums aren't.
+  template<bool isPair, typename T>
+  static double forwardCells( T* fM0, T* fD0, T* fI0, T* fP0,
+			      const T* fM2, const T* fD1, const T* fI1,
+			      const T* fP2, const T* match, const T* edge,
+			      size_t numCells, const CellFactors<T>& f,
+			      bool isGlobal, double& Z ){
+    size_t i = 0;
+    double sum = 0.0;
+#ifdef SIMD_DOUBLE_LEN
+    typedef typename SimdType<T>::V V;
+    const size_t len = SimdType<T>::len;
+    const V vScale12 = simdFill( f.scale12 );
+    const V vSeE = simdFill( f.seE );
+    const V vSeEI = simdFill( f.seEI );
+    const V vSeP = simdFill( f.seP );
+    const V vEF = simdFill( f.eF );
+    const V vEFI = simdFill( f.eFI );
+    V vSum = simdFill( T(0) );
+    V vZ = vSum;
+    for( ; i + len <= numCells; i += len ){
+      const V xM = simdMul( simdLoad( fM2 + i ), vScale12 );
+      const V xD = simdMul( simdLoad( fD1 + i ), vSeE );
+      const V xI = simdMul( simdLoad( fI1 + i ), vSeEI );
+      V d = simdAdd( simdMul( xM, vEF ), xD );
+      V n = simdAdd( simdMul( simdAdd( xM, xD ), vEFI ), xI );
+      V x = simdAdd( simdAdd( xM, xD ), xI );
+      if( isPair ){
+	const V xP = simdMul( simdLoad( fP2 + i ), vSeP );
+	d = simdAdd( d, xP );
+	n = simdAdd( n, xP );
+	x = simdAdd( x, xP );
+	simdStore( fP0 + i, simdAdd( simdMul( xM, vEF ), xP ) );
+      }
+      simdStore( fD0 + i, d );
+      simdStore( fI0 + i, n );
+      simdStore( fM0 + i, simdMul( x, simdLoad( match + i ) ) );
+      vSum = simdAdd( vSum, xM );
+      if( isGlobal ) vZ = simdAdd( vZ, simdMul( x, simdLoad( edge + i ) ) );
+    }
+    sum = simdSum( vSum );
+    if( isGlobal ) Z += simdSum( vZ );
+#endif
+    for( ; i < numCells; ++i ){
+      const T xM = fM2[ i ] * f.scale12;
+      const T xD = fD1[ i ] * f.seE;
+      const T xI = fI1[ i ] * f.seEI;
+      T d = xM * f.eF + xD;
+      T n = ( xM + xD ) * f.eFI + xI;
+      T x = xM + xD + xI;
+      if( isPair ){
+	const T xP = fP2[ i ] * f.seP;
+	d += xP;
+	n += xP;
+	x += xP;
+	fP0[ i ] = xM * f.eF + xP;
+      }
+      fD0[ i ] = d;
+      fI0[ i ] = n;
+      fM0[ i ] = x * match[ i ];
+      sum += xM;
+      if( isGlobal && edge[ i ] ) Z += x;
+    }
+    return sum;
+  }
+
+  void Centroid::forwardSegment( const Input& in, size_t s, double& Z,
+				 bool isFirstPass ){
+    const size_t beg = segmentBegs[ s ];
+    const size_t end = segmentBegs[ s + 1 ];
+    const size_t base = segmentBase( beg );
+
+    for( size_t k = beg; k < end; ++k ){  // loop over antidiagonals
+      const size_t seq1beg = seq1start( k );
+      const size_t seq2pos = k - seq1beg;
+      const double scale12 = 1.0 / ( scale[k+1] * scale[k] );
+      const double scale1  = 1.0 / scale[k+1];
+
+      const CellFactors<prob_t> f = { prob_t( scale12 ),
+				      prob_t( in.eE * scale1 ),
+				      prob_t( in.eEI * scale1 ),
+				      prob_t( in.eP * scale12 ),
+				      prob_t( in.eF ), prob_t( in.eFI ) };
+
+      const size_t scoreEnd = xa.scoreEndIndex( k ) - base;
+      const size_t numCells = xa.numCellsAndPads( k ) - 1;
+
+      // add one pad cell
+      fM[ scoreEnd ] = fD[ scoreEnd ] = fI[ scoreEnd ] = fP[ scoreEnd ] = 0.0;
+
+      const size_t horiBeg = xa.hori( k, seq1beg ) - base;
+      const size_t vertBeg = xa.vert( k, seq1beg ) - base;
+      const size_t diagBeg = xa.diag( k, seq1beg ) - base;
+
+      getMatchProbs( in, seq1beg, seq2pos, numCells );
+
+      const double sum_f = in.isPair ?
+	forwardCells<true>( &fM[ scoreEnd + 1 ], &fD[ scoreEnd + 1 ],
+			    &fI[ scoreEnd + 1 ], &fP[ scoreEnd + 1 ],
+			    &fM[ diagBeg ], &fD[ horiBeg ], &fI[ vertBeg ],
+			    &fP[ diagBeg ], &matchProbs[0], &edgeFlags[0],
+			    numCells, f, in.globality, Z ) :
+	forwardCells<false>( &fM[ scoreEnd + 1 ], &fD[ scoreEnd + 1 ],
+			     &fI[ scoreEnd + 1 ], &fP[ scoreEnd + 1 ],
+			     &fM[ diagBeg ], &fD[ horiBeg ], &fI[ vertBeg ],
+			     &fP[ diagBeg ], &matchProbs[0], &edgeFlags[0],
+			     numCells, f, in.globality, Z );
+
+      if( isFirstPass ){
+	if( !in.globality ) Z += sum_f;
+	scale[k+2] = sum_f + 1.0;  // seems ugly
+	Z /= scale[k+2]; // scaling
+      }
+    } // k
+  }
+
   void Centroid::forward( const uchar* seq1, const uchar* seq2,
 			  size_t start1, size_t start2,
 			  bool isForward, int globality,
 			  const GeneralizedAffineGapCosts& gap ){
 
     //std::cout << "[forward] start1=" << start1 << "," << "start2=" << start2 << "," << "isForward=" << isForward << std::endl;
-    seq1 += start1;
-    seq2 += start2;
-    const ExpMatrixRow* pssm = isPssm ? pssmExp2 + start2 : 0;
-    const int seqIncrement = isForward ? 1 : -1;
+    const Input in = makeInput( seq1, seq2, start1, start2,
+				isForward, globality, gap );
 
     initForwardMatrix();
 
     double Z = 0.0;  // partion function of forward values
 
-    const bool isAffine = gap.isAffine();
-    const int E = gap.delExtend;
-    const int F = gap.delExist;
-    const int EI = gap.insExtend;
-    const int FI = gap.insExist;
-    const int P = gap.pairExtend;
-    const double eE = EXP ( - E / T );
-    const double eF = EXP ( - F / T );
-    const double eEI = EXP ( - EI / T );
-    const double eFI = EXP ( - FI / T );
-    const double eP = EXP ( - P / T );
-
-    assert( gap.insExist == gap.delExist || eP <= 0.0 );
-
-    for( size_t k = 0; k < numAntidiagonals; ++k ){  // loop over antidiagonals
-      double sum_f = 0.0; // sum of forward values
+    for( size_t s = 0; s + 1 < segmentBegs.size(); ++s ){
+      if( s > 0 ) copyCheckpoint( fCheckpoints, fM, fD, fI, fP, s, s-1, true );
+      initForwardSegment( s );
+      forwardSegment( in, s, Z, true );
+    }
+
+    //std::cout << "# Z=" << Z << std::endl;
+    assert( Z > 0.0 );
+    scale[ numAntidiagonals + 1 ] *= Z;  // this causes scaled Z to equal 1
+  }
+
+  // Calculate the backward values of the cells in one antidiagonal,
+  // their posterior match probabilities, and their contributions to
+  // mD, mI, mX1, mX2.  The contributions to mI and mX2 are put in
+  // insProbs and notProbs2, because seq2 goes backwards along the
+  // antidiagonal.  Each cell's values are identical with or without
+  // SIMD.
+  template<bool isPair, typename T>
+  static void backwardCells( T* bM2, T* bD1, T* bI1, T* bP2, T* pp0,
+			     T* mD1, T* mX1, T* insProbs, T* notProbs2,
+			     const T* bM0, const T* bD0, const T* bI0,
+			     const T* bP0, const T* fM2, const T* fD1,
+			     const T* fI1, const T* fP2,
+			     const T* match, const T* edge, size_t numCells,
+			     const CellFactors<T>& f, bool isGlobal,
+			     T scaledUnit ){
+    size_t i = 0;
+#ifdef SIMD_DOUBLE_LEN
+    typedef typename SimdType<T>::V V;
+    const size_t len = SimdType<T>::len;
+    const V vScale12 = simdFill( f.scale12 );
+    const V vSeE = simdFill( f.seE );
+    const V vSeEI = simdFill( f.seEI );
+    const V vSeP = simdFill( f.seP );
+    const V vEF = simdFill( f.eF );
+    const V vEFI = simdFill( f.eFI );
+    const V vUnit = simdFill( scaledUnit );
+    const V vZero = simdFill( T(0) );
+    for( ; i + len <= numCells; i += len ){
+      const V yM = simdMul( simdLoad( bM0 + i ), simdLoad( match + i ) );
+      const V yD = simdLoad( bD0 + i );
+      const V yI = simdLoad( bI0 + i );
+      const V u = isGlobal ? simdMul( vUnit, simdLoad( edge + i ) ) : vZero;
+      V zM = simdAdd( simdAdd( yM, simdMul( yD, vEF ) ),
+		      simdMul( yI, vEFI ) );
+      const V zD = simdAdd( simdAdd( simdAdd( yM, yD ), simdMul( yI, vEFI ) ),
+			    u );
+      const V zI = simdAdd( simdAdd( yM, yI ), u );
+      V probp = vZero;
+      if( isPair ){
+	const V yP = simdLoad( bP0 + i );
+	zM = simdAdd( zM, simdMul( yP, vEF ) );
+	const V zP = simdAdd( simdAdd( simdAdd( simdAdd( yM, yP ), yD ), yI ),
+			      u );
+	const V p = simdMul( zP, vSeP );
+	simdStore( bP2 + i, p );
+	probp = simdMul( simdLoad( fP2 + i ), p );
+      }
+      zM = simdAdd( zM, isGlobal ? u : vUnit );
+      const V m = simdMul( zM, vScale12 );
+      const V d = simdMul( zD, vSeE );
+      const V n = simdMul( zI, vSeEI );
+      simdStore( bM2 + i, m );
+      simdStore( bD1 + i, d );
+      simdStore( bI1 + i, n );
+      const V prob = simdMul( simdLoad( fM2 + i ), m );
+      const V probd = simdMul( simdLoad( fD1 + i ), d );
+      const V probi = simdMul( simdLoad( fI1 + i ), n );
+      simdStore( pp0 + i, prob );
+      simdStore( mD1 + i, simdAdd( simdLoad( mD1 + i ),
+				   simdAdd( probd, probp ) ) );
+      simdStore( mX1 + i, simdSub( simdLoad( mX1 + i ),
+				   simdAdd( simdAdd( prob, probd ), probp ) ) );
+      simdStore( insProbs + i, simdAdd( probi, probp ) );
+      simdStore( notProbs2 + i, simdAdd( simdAdd( prob, probi ), probp ) );
+    }
+#endif
+    for( ; i < numCells; ++i ){
+      const T yM = bM0[ i ] * match[ i ];
+      const T yD = bD0[ i ];
+      const T yI = bI0[ i ];
+      T zM = yM + yD * f.eF + yI * f.eFI;
+      T zD = yM + yD + yI * f.eFI;
+      T zI = yM + yI;
+      const T u = ( isGlobal && edge[ i ] ) ? scaledUnit : T(0);
+      zD += u;
+      zI += u;
+      T probp = 0;
+      if( isPair ){
+	const T yP = bP0[ i ];
+	zM += yP * f.eF;
+	const T zP = yM + yP + yD + yI + u;
+	bP2[ i ] = zP * f.seP;
+	probp = fP2[ i ] * bP2[ i ];
+      }
+      zM += isGlobal ? u : scaledUnit;
+      bM2[ i ] = zM * f.scale12;
+      bD1[ i ] = zD * f.seE;
+      bI1[ i ] = zI * f.seEI;
+      const T prob = fM2[ i ] * bM2[ i ];
+      const T probd = fD1[ i ] * bD1[ i ];
+      const T probi = fI1[ i ] * bI1[ i ];
+      pp0[ i ] = prob;
+      mD1[ i ] += probd + probp;
+      mX1[ i ] -= ( prob + probd + probp );
+      insProbs[ i ] = probi + probp;
+      notProbs2[ i ] = prob + probi + probp;
+    }
+  }
+  void Centroid::backwardSegment( const Input& in, size_t s,
+				  double& scaledUnit, bool isReplay ){
+    const size_t beg = segmentBegs[ s ];
+    const size_t end = segmentBegs[ s + 1 ];
+    const size_t base = segmentBase( beg );
+
+    for( size_t k = end; k-- > beg; ){
       const size_t seq1beg = seq1start( k );
       const size_t seq2pos = k - seq1beg;
       const double scale12 = 1.0 / ( scale[k+1] * scale[k] );
       const double scale1  = 1.0 / scale[k+1];
+      scaledUnit /= scale[k+2];
 
-      const double seE = eE * scale1;
-      const double seEI = eEI * scale1;
-      const double seP = eP * scale12;
-
-      const size_t scoreEnd = xa.scoreEndIndex( k );
-      double* fM0 = &fM[ scoreEnd ];
-      double* fD0 = &fD[ scoreEnd ];
-      double* fI0 = &fI[ scoreEnd ];
-      double* fP0 = &fP[ scoreEnd ];
-
-      const size_t horiBeg = xa.hori( k, seq1beg );
-      const size_t vertBeg = xa.vert( k, seq1beg );
-      const size_t diagBeg = xa.diag( k, seq1beg );
-      const double* fD1 = &fD[ horiBeg ];
-      const double* fI1 = &fI[ vertBeg ];
-      const double* fM2 = &fM[ diagBeg ];
-      const double* fP2 = &fP[ diagBeg ];
-
-      const double* fM0last = fM0 + xa.numCellsAndPads( k ) - 1;
-
-      const uchar* s1 = seqPtr( seq1, isForward, seq1beg );
-
-      *fM0++ = *fD0++ = *fI0++ = *fP0++ = 0.0;  // add one pad cell
-
-      if (! isPssm) {
-	const uchar* s2 = seqPtr( seq2, isForward, seq2pos );
+      const CellFactors<prob_t> f = { prob_t( scale12 ),
+				      prob_t( in.eE * scale1 ),
+				      prob_t( in.eEI * scale1 ),
+				      prob_t( in.eP * scale12 ),
+				      prob_t( in.eF ), prob_t( in.eFI ) };
+
+      const size_t scoreEnd = xa.scoreEndIndex( k ) - base;
+      const size_t numCells = xa.numCellsAndPads( k ) - 1;
+
+      const size_t horiBeg = xa.hori( k, seq1beg ) - base;
+      const size_t vertBeg = xa.vert( k, seq1beg ) - base;
+      const size_t diagBeg = xa.diag( k, seq1beg ) - base;
+
+      getMatchProbs( in, seq1beg, seq2pos, numCells );
+
+      prob_t* pp0 = &pp[ xa.scoreEndIndex( k ) ];
+      prob_t* mD1 = &mD[ seq1beg ];
+      prob_t* mX1p = &mX1[ seq1beg ];
+      if( isReplay ) pp0 = mD1 = mX1p = &replayProbs[0];
+
+      if( in.isPair ){
+	backwardCells<true>( &bM[ diagBeg ], &bD[ horiBeg ], &bI[ vertBeg ],
+			     &bP[ diagBeg ], pp0, mD1, mX1p,
+			     &insProbs[0], &notProbs2[0],
+			     &bM[ scoreEnd + 1 ], &bD[ scoreEnd + 1 ],
+			     &bI[ scoreEnd + 1 ], &bP[ scoreEnd + 1 ],
+			     &fM[ diagBeg ], &fD[ horiBeg ], &fI[ vertBeg ],
+			     &fP[ diagBeg ], &matchProbs[0], &edgeFlags[0],
+			     numCells, f, in.globality, prob_t( scaledUnit ) );
+      }else{
+	backwardCells<false>( &bM[ diagBeg ], &bD[ horiBeg ], &bI[ vertBeg ],
+			      &bP[ diagBeg ], pp0, mD1, mX1p,
+			      &insProbs[0], &notProbs2[0],
+			      &bM[ scoreEnd + 1 ], &bD[ scoreEnd + 1 ],
+			      &bI[ scoreEnd + 1 ], &bP[ scoreEnd + 1 ],
+			      &fM[ diagBeg ], &fD[ horiBeg ], &fI[ vertBeg ],
+			      &fP[ diagBeg ], &matchProbs[0], &edgeFlags[0],
+			      numCells, f, in.globality, prob_t( scaledUnit ) );
+      }
 
-	while (1) {	// start: inner most loop
-	  const double xM = *fM2 * scale12;
-	  const double xD = *fD1 * seE;
-	  const double xI = *fI1 * seEI;
-	  const double xP = *fP2 * seP;
-	  *fD0 = xM * eF + xD + xP;
-	  *fI0 = (xM + xD) * eFI + xI + xP;
-	  *fM0 = (xM + xD + xI + xP) * match_score[ *s1 ][ *s2 ];
-	  *fP0 = xM * eF + xP;
-	  sum_f += xM;
-	  if( globality && (isDelimiter(*s2, *match_score) ||
-			    isDelimiter(*s1, *match_score)) ){
-	    Z += xM + xD + xI + xP;
-	  }
-	  if (fM0 == fM0last) break;
-	  fM0++; fD0++; fI0++; fP0++;
-	  fM2++; fD1++; fI1++; fP2++;
-	  s1 += seqIncrement;
-	  s2 -= seqIncrement;
-	}	// end: inner most loop
-      } // end: if (! isPssm)
-      else {
-	const ExpMatrixRow* p2 = seqPtr( pssm, isForward, seq2pos );
+      if( isReplay ) continue;
 
-	if (isAffine) {
-	  while (1) { // start: inner most loop
-	    const double xM = *fM2 * scale12;
-	    const double xD = *fD1 * seE;
-	    const double xI = *fI1 * seE;
-	    *fD0 = xM * eF + xD;
-	    *fI0 = (xM + xD) * eF + xI;
-	    *fM0 = (xM + xD + xI) * (*p2)[ *s1 ];
-	    sum_f += xM;
-	    if ( globality && (isDelimiter(0, *p2) ||
-			       isDelimiter(*s1, *pssm)) ){
-	      Z += xM + xD + xI;
-	    }
-	    if (fM0 == fM0last) break;
-	    fM0++; fD0++; fI0++;
-	    fM2++; fD1++; fI1++;
-	    s1 += seqIncrement;
-	    p2 -= seqIncrement;
-	  }	// end: inner most loop
-	}else{
-	  while (1) { // start: inner most loop
-	    const double xM = *fM2 * scale12;
-	    const double xD = *fD1 * seE;
-	    const double xI = *fI1 * seEI;
-	    const double xP = *fP2 * seP;
-	    *fD0 = xM * eF + xD + xP;
-	    *fI0 = (xM + xD) * eFI + xI + xP;
-	    *fM0 = (xM + xD + xI + xP) * (*p2)[ *s1 ];
-	    *fP0 = xM * eF + xP;
-	    sum_f += xM;
-	    if ( globality && (isDelimiter(0, *p2) ||
-			       isDelimiter(*s1, *pssm)) ){
-	      Z += xM + xD + xI + xP;
-	    }
-	    if (fM0 == fM0last) break;
-	    fM0++; fD0++; fI0++; fP0++;
-	    fM2++; fD1++; fI1++; fP2++;
-	    s1 += seqIncrement;
-	    p2 -= seqIncrement;
-	  }	// end: inner most loop
-	}
+      // seq2 goes backwards along the antidiagonal
+      for( size_t c = 0; c < numCells; ++c ){
+	mI[ seq2pos - c ] += insProbs[ c ];
+	mX2[ seq2pos - c ] -= notProbs2[ c ];
       }
-      if( !globality ) Z += sum_f;
-      scale[k+2] = sum_f + 1.0;  // seems ugly
-      Z /= scale[k+2]; // scaling
-    } // k
-    //std::cout << "# Z=" << Z << std::endl;
-    assert( Z > 0.0 );
-    scale[ numAntidiagonals + 1 ] *= Z;  // this causes scaled Z to equal 1
+    }
   }
 
   // added by M. Hamada
@@ -287,198 +597,24 @@ namespace cbrc{
 			   const GeneralizedAffineGapCosts& gap ){
 
     //std::cout << "[backward] start1=" << start1 << "," << "start2=" << start2 << "," << "isForward=" << isForward << std::endl;
-    seq1 += start1;
-    seq2 += start2;
-    const ExpMatrixRow* pssm = isPssm ? pssmExp2 + start2 : 0;
-    const int seqIncrement = isForward ? 1 : -1;
+    const Input in = makeInput( seq1, seq2, start1, start2,
+				isForward, globality, gap );
 
     initBackwardMatrix();
 
-    const bool isAffine = gap.isAffine();
-    const int E = gap.delExtend;
-    const int F = gap.delExist;
-    const int EI = gap.insExtend;
-    const int FI = gap.insExist;
-    const int P = gap.pairExtend;
-    const double eE = EXP ( - E / T );
-    const double eF = EXP ( - F / T );
-    const double eEI = EXP ( - EI / T );
-    const double eFI = EXP ( - FI / T );
-    const double eP = EXP ( - P / T );
     double scaledUnit = 1.0;
 
-    assert( gap.insExist == gap.delExist || eP <= 0.0 );
-
-    for( size_t k = numAntidiagonals; k-- > 0; ){
-      const size_t seq1beg = seq1start( k );
-      const size_t seq2pos = k - seq1beg;
-      const double scale12 = 1.0 / ( scale[k+1] * scale[k] );
-      const double scale1  = 1.0 / scale[k+1];
-      scaledUnit /= scale[k+2];
-
-      const double seE = eE * scale1;
-      const double seEI = eEI * scale1;
-      const double seP = eP * scale12;
-
-      const size_t scoreEnd = xa.scoreEndIndex( k );
-      const double* bM0 = &bM[ scoreEnd + 1 ];
-      const double* bD0 = &bD[ scoreEnd + 1 ];
-      const double* bI0 = &bI[ scoreEnd + 1 ];
-      const double* bP0 = &bP[ scoreEnd + 1 ];
-
-      double* pp0 = &pp[ scoreEnd ];
-
-      const size_t horiBeg = xa.hori( k, seq1beg );
-      const size_t vertBeg = xa.vert( k, seq1beg );
-      const size_t diagBeg = xa.diag( k, seq1beg );
-      double* bD1 = &bD[ horiBeg ];
-      double* bI1 = &bI[ vertBeg ];
-      double* bM2 = &bM[ diagBeg ];
-      double* bP2 = &bP[ diagBeg ];
-
-      const double* fM2 = &fM[ diagBeg ];
-      const double* fD1 = &fD[ horiBeg ];
-      const double* fI1 = &fI[ vertBeg ];
-      const double* fP2 = &fP[ diagBeg ];
-
-      const double* bM0last = bM0 + xa.numCellsAndPads( k ) - 2;
-
-      int i = seq1beg; int j = seq2pos;
-
-      const uchar* s1 = seqPtr( seq1, isForward, seq1beg );
-
-      if (! isPssm ) {
-	const uchar* s2 = seqPtr( seq2, isForward, seq2pos );
-
-	while (1) { // inner most loop
-	  double yM = *bM0 * match_score[ *s1 ][ *s2 ];
-	  double yD = *bD0;
-	  double yI = *bI0;
-	  double yP = *bP0;
-	  double zM = yM + yD * eF + yI * eFI + yP * eF;
-	  double zD = yM + yD + yI * eFI;
-	  double zI = yM + yI;
-	  double zP = yM + yP + yD + yI;
-	  if( globality ){
-	    if( isDelimiter(*s2, *match_score) ||
-		isDelimiter(*s1, *match_score) ){
-	      zM += scaledUnit;  zD += scaledUnit;  zI += scaledUnit;
-	      zP += scaledUnit;
-	    }
-	  }else{
-	    zM += scaledUnit;
-	  }
-	  *bM2 = zM * scale12;
-	  *bD1 = zD * seE;
-	  *bI1 = zI * seEI;
-	  *bP2 = zP * seP;
-
-	  double prob = *fM2 * *bM2;
-	  *pp0 = prob;
-	  double probd = *fD1 * *bD1;
-	  double probi = *fI1 * *bI1;
-	  double probp = *fP2 * *bP2;
-	  mD[ i ] += probd + probp;
-	  mI[ j ] += probi + probp;
-	  mX1 [ i ] -= ( prob + probd + probp );
-	  mX2 [ j ] -= ( prob + probi + probp );
-
-	  if (bM0 == bM0last) break;
-	  i++; j--;
-	  bM2++; bD1++; bI1++; bP2++;
-	  bM0++; bD0++; bI0++; bP0++;
-	  fM2++; fD1++; fI1++; fP2++;
-	  pp0++;
-	  s1 += seqIncrement;
-	  s2 -= seqIncrement;
-	}
-      }
-      else {
-	const ExpMatrixRow* p2 = seqPtr( pssm, isForward, seq2pos );
-
-	if (isAffine) {
-	  while (1) { // inner most loop
-	    double yM = *bM0 * ( *p2 )[ *s1 ];
-	    double yD = *bD0;
-	    double yI = *bI0;
-	    double zM = yM + yD * eF + yI * eF;
-	    double zD = yM + yD + yI * eF;
-	    double zI = yM + yI;
-	    if( globality ){
-	      if( isDelimiter(0, *p2) ||
-		  isDelimiter(*s1, *pssm) ){
-		zM += scaledUnit;  zD += scaledUnit;  zI += scaledUnit;
-	      }
-	    }else{
-	      zM += scaledUnit;
-	    }
-	    *bM2 = zM * scale12;
-	    *bD1 = zD * seE;
-	    *bI1 = zI * seE;
-
-	    double prob = *fM2 * *bM2;
-	    *pp0 = prob;
-	    double probd = *fD1 * *bD1;
-	    double probi = *fI1 * *bI1;
-	    mD[ i ] += probd;
-	    mI[ j ] += probi;
-	    mX1 [ i ] -= ( prob + probd );
-	    mX2 [ j ] -= ( prob + probi );
-
-	    if (bM0 == bM0last) break;
-	    i++; j--;
-	    bM2++; bD1++; bI1++;
-	    bM0++; bD0++; bI0++;
-	    fM2++; fD1++; fI1++;
-	    pp0++;
-	    s1 += seqIncrement;
-	    p2 -= seqIncrement;
-	  }
-	}else{
-	  while (1) {
-	    double yM = *bM0 * ( *p2 )[ *s1 ];
-	    double yD = *bD0;
-	    double yI = *bI0;
-	    double yP = *bP0;
-	    double zM = yM + yD * eF + yI * eFI + yP * eF;
-	    double zD = yM + yD + yI * eFI;
-	    double zI = yM + yI;
-	    double zP = yM + yP + yD + yI;
-	    if( globality ){
-	      if( isDelimiter(0, *p2) ||
-		  isDelimiter(*s1, *pssm) ){
-		zM += scaledUnit;  zD += scaledUnit;  zI += scaledUnit;
-		zP += scaledUnit;
-	      }
-	    }else{
-	      zM += scaledUnit;
-	    }
-	    *bM2 = zM * scale12;
-	    *bD1 = zD * seE;
-	    *bI1 = zI * seEI;
-	    *bP2 = zP * seP;
-
-	    double prob = *fM2 * *bM2;
-	    *pp0 = prob;
-	    double probd = *fD1 * *bD1;
-	    double probi = *fI1 * *bI1;
-	    double probp = *fP2 * *bP2;
-	    mD[ i ] += probd + probp;
-	    mI[ j ] += probi + probp;
-	    mX1 [ i ] -= ( prob + probd + probp );
-	    mX2 [ j ] -= ( prob + probi + probp );
-
-	    if (bM0 == bM0last) break;
-	    i++; j--;
-	    bM2++; bD1++; bI1++; bP2++;
-	    bM0++; bD0++; bI0++; bP0++;
-	    fM2++; fD1++; fI1++; fP2++;
-	    pp0++;
-	    s1 += seqIncrement;
-	    p2 -= seqIncrement;
-	  }
-	}
+    // The forward values of the last segment are still there
+    for( size_t s = segmentBegs.size() - 1; s-- > 0; ){
+      if( s + 2 < segmentBegs.size() ){
+	double Z = 0.0;  // ignored
+	initForwardSegment( s );
+	forwardSegment( in, s, Z, false );
       }
+      segmentUnits[ s ] = scaledUnit;
+      initBackwardSegment( s );
+      backwardSegment( in, s, scaledUnit, false );
+      if( s > 0 ) copyCheckpoint( bCheckpoints, bM, bD, bI, bP, s, s, true );
     }
 
     //std::cout << "# bM[0]=" << bM[0] << std::endl;
@@ -499,31 +635,60 @@ namespace cbrc{
     else if (outputType==6) traceback_ama( chunks, gamma);
   }
 
+  // Calculate the gamma-centroid scores of the cells in one
+  // antidiagonal, and return the highest one.  The results are
+  // identical with or without SIMD.
+  template<typename T>
+  static T centroidCells( T* X0, const T* X1, const T* X2, const T* P0,
+			  size_t numCells, T gammaPlus1 ){
+    size_t i = 0;
+    T maxScore = -DINF;
+#ifdef SIMD_DOUBLE_LEN
+    typedef typename SimdType<T>::V V;
+    const size_t len = SimdType<T>::len;
+    const V vGamma = simdFill( gammaPlus1 );
+    const V vOne = simdFill( T(1) );
+    V vMax = simdFill( maxScore );
+    for( ; i + len <= numCells; i += len ){
+      const V s = simdSub( simdMul( vGamma, simdLoad( P0 + i ) ), vOne );
+      const V x = simdMax( simdLoad( X1 + i ), simdLoad( X1 + i + 1 ) );
+      const V score = simdMax( x, simdAdd( simdLoad( X2 + i ), s ) );
+      simdStore( X0 + i, score );
+      vMax = simdMax( vMax, score );
+    }
+    T lanes[ len ];
+    simdStore( lanes, vMax );
+    maxScore = *std::max_element( lanes, lanes + len );
+#endif
+    for( ; i < numCells; ++i ){
+      const T s = gammaPlus1 * P0[ i ] - 1;
+      X0[ i ] = std::max( std::max( X1[ i ], X1[ i + 1 ] ), X2[ i ] + s );
+      maxScore = std::max( maxScore, X0[ i ] );
+    }
+    return maxScore;
+  }
+
   double Centroid::dp_centroid( double gamma ){
 
     initDecodingMatrix();
 
     for( size_t k = 1; k < numAntidiagonals; ++k ){  // loop over antidiagonals
       const size_t scoreEnd = xa.scoreEndIndex( k );
-      double* X0 = &X[ scoreEnd ];
-      const double* P0 = &pp[ scoreEnd ];
-      size_t cur = seq1start( k );
-
-      const double* const x0end = X0 + xa.numCellsAndPads( k );
-      const double* X1 = &X[xa.hori(k, cur)];
-      const double* X2 = &X[xa.diag(k, cur)];
+      const size_t cur = seq1start( k );
+      const size_t numCells = xa.numCellsAndPads( k ) - 1;
+      prob_t* X0 = &X[ scoreEnd ];
 
       *X0++ = -DINF;		// add one pad cell
 
-      do{
-	const double s = ( gamma + 1 ) * ( *P0++ ) - 1;
-	const double oldX1 = *X1++;  // Added by MCF
-	const double score = std::max( std::max( oldX1, *X1 ), *X2++ + s );
-	//assert ( score >= 0 );
-	updateScore ( score, k, cur );
-	*X0++ = score;
-	cur++;
-      }while( X0 != x0end );
+      const prob_t maxScore =
+	centroidCells( X0, &X[ xa.hori( k, cur ) ], &X[ xa.diag( k, cur ) ],
+		       &pp[ scoreEnd ], numCells, prob_t( gamma + 1 ) );
+
+      //assert ( maxScore >= 0 );
+      if( maxScore > bestScore ){  // the first cell with the highest score
+	size_t c = std::find( X0, X0 + numCells, maxScore ) - X0;
+	updateScore( maxScore, k, cur + c );
+      }
     }
     return bestScore;
   }
@@ -535,10 +700,11 @@ namespace cbrc{
     size_t k = bestAntiDiagonal;
     size_t i = bestPos1;
     size_t oldPos1 = i;
+    const prob_t g1 = gamma + 1;
 
     while( k > 0 ){
       const int m =
-	maxIndex( diagx( X, k, i ) + ( gamma + 1 ) * cellx( pp, k, i ) - 1,
+	maxIndex( diagx( X, k, i ) + ( g1 * cellx( pp, k, i ) - 1 ),
                   horix( X, k, i ),
                   vertx( X, k, i ) );
       if( m == 0 ){
@@ -559,26 +725,27 @@ namespace cbrc{
   double Centroid::dp_ama( double gamma ){
 
     initDecodingMatrix();
+    const prob_t g = gamma;
 
     for( size_t k = 1; k < numAntidiagonals; ++k ){  // loop over antidiagonals
       const size_t scoreEnd = xa.scoreEndIndex( k );
-      double* X0 = &X[ scoreEnd ];
-      const double* P0 = &pp[ scoreEnd ];
+      prob_t* X0 = &X[ scoreEnd ];
+      const prob_t* P0 = &pp[ scoreEnd ];
       size_t cur = seq1start( k );
       size_t seq2pos = k - cur;
 
-      const double* const x0end = X0 + xa.numCellsAndPads( k );
-      const double* X1 = &X[ xa.hori(k, cur) ];
-      const double* X2 = &X[ xa.diag(k, cur) ];
+      const prob_t* const x0end = X0 + xa.numCellsAndPads( k );
+      const prob_t* X1 = &X[ xa.hori(k, cur) ];
+      const prob_t* X2 = &X[ xa.diag(k, cur) ];
 
       *X0++ = -DINF;		// add one pad cell
 
       do{
-	const double s = 2 * gamma * *P0++ - ( mX1[ cur ] + mX2[ seq2pos ] );
-	const double oldX1 = *X1++;  // Added by MCF
-	const double u = gamma * mD[ cur ] - mX1[ cur ];
-	const double t = gamma * mI[ seq2pos ] - mX2[ seq2pos ];
-	const double score = std::max( std::max( oldX1 + u, *X1 + t), *X2++ + s );
+	const prob_t s = 2 * g * *P0++ - ( mX1[ cur ] + mX2[ seq2pos ] );
+	const prob_t oldX1 = *X1++;  // Added by MCF
+	const prob_t u = g * mD[ cur ] - mX1[ cur ];
+	const prob_t t = g * mI[ seq2pos ] - mX2[ seq2pos ];
+	const prob_t score = std::max( std::max( oldX1 + u, *X1 + t), *X2++ + s );
 	updateScore ( score, k, cur );
 	*X0++ = score;
 	cur++;
@@ -596,12 +763,13 @@ namespace cbrc{
     size_t k = bestAntiDiagonal;
     size_t i = bestPos1;
     size_t oldPos1 = i;
+    const prob_t g = gamma;
 
     while( k > 0 ){
       const size_t j = k - i;
-      const double s = 2 * gamma * cellx( pp, k, i ) - ( mX1[ i ] + mX2[ j ] );
-      const double t = gamma * mI[ j ] - mX2[ j ];
-      const double u = gamma * mD[ i ] - mX1[ i ];
+      const prob_t s = 2 * g * cellx( pp, k, i ) - ( mX1[ i ] + mX2[ j ] );
+      const prob_t t = g * mI[ j ] - mX2[ j ];
+      const prob_t u = g * mD[ i ] - mX1[ i ];
       const int m =
 	maxIndex( diagx( X, k, i ) + s,
                   horix( X, k, i ) + u,
@@ -636,8 +804,9 @@ namespace cbrc{
     return static_cast<uchar>(k);
   }
 
+  template<typename T>
   static void getGapAmbiguities( std::vector<uchar>& ambiguityCodes,
-                                    const std::vector<double>& probs,
+                                    const std::vector<T>& probs,
                                     size_t rbeg, size_t rend ){
     for( size_t i = rbeg; i > rend; --i ){
       ambiguityCodes.push_back( asciiProbability( probs[ i ] ) );
@@ -684,31 +853,24 @@ namespace cbrc{
     return T * x;
   }
 
-  void Centroid::computeExpectedCounts ( const uchar* seq1, const uchar* seq2,
-					 size_t start1, size_t start2,
-					 bool isForward,
-					 const GeneralizedAffineGapCosts& gap,
-					 ExpectedCount& c ) const{
-    seq1 += start1;
-    seq2 += start2;
-    const ExpMatrixRow* pssm = isPssm ? pssmExp2 + start2 : 0;
+  void Centroid::addExpectedCounts( const Input& in, size_t s,
+				    ExpectedCount& c ) const{
+    const ExpMatrixRow* pssm = in.pssm;
+    const bool isForward = in.isForward;
     const int seqIncrement = isForward ? 1 : -1;
 
-    const bool isAffine = gap.isAffine();
-    const int E = gap.delExtend;
-    const int F = gap.delExist;
-    const int EI = gap.insExtend;
-    const int FI = gap.insExist;
-    const int P = gap.pairExtend;
-    const double eE = EXP ( - E / T );
-    const double eF = EXP ( - F / T );
-    const double eEI = EXP ( - EI / T );
-    const double eFI = EXP ( - FI / T );
-    const double eP = EXP ( - P / T );
-
-    assert( gap.insExist == gap.delExist || eP <= 0.0 );
-
-    for( size_t k = 0; k < numAntidiagonals; ++k ){  // loop over antidiagonals
+    const bool isAffine = !in.isPair;
+    const double eE = in.eE;
+    const double eF = in.eF;
+    const double eEI = in.eEI;
+    const double eFI = in.eFI;
+    const double eP = in.eP;
+
+    const size_t beg = segmentBegs[ s ];
+    const size_t end = segmentBegs[ s + 1 ];
+    const size_t base = segmentBase( beg );
+
+    for( size_t k = beg; k < end; ++k ){  // loop over antidiagonals
       const size_t seq1beg = seq1start( k );
       const size_t seq2pos = k - seq1beg;
       const double scale12 = 1.0 / ( scale[k+1] * scale[k] );
@@ -718,24 +880,24 @@ namespace cbrc{
       const double seEI = eEI * scale1;
       const double seP = eP * scale12;
 
-      const uchar* s1 = seqPtr( seq1, isForward, seq1beg );
-      const uchar* s2 = seqPtr( seq2, isForward, seq2pos );
+      const uchar* s1 = seqPtr( in.seq1, isForward, seq1beg );
+      const uchar* s2 = seqPtr( in.seq2, isForward, seq2pos );
 
-      const size_t scoreEnd = xa.scoreEndIndex( k );
-      const double* bM0 = &bM[ scoreEnd + 1 ];
-      const double* bD0 = &bD[ scoreEnd + 1 ];
-      const double* bI0 = &bI[ scoreEnd + 1 ];
-      const double* bP0 = &bP[ scoreEnd + 1 ];
+      const size_t scoreEnd = xa.scoreEndIndex( k ) - base;
+      const prob_t* bM0 = &bM[ scoreEnd + 1 ];
+      const prob_t* bD0 = &bD[ scoreEnd + 1 ];
+      const prob_t* bI0 = &bI[ scoreEnd + 1 ];
+      const prob_t* bP0 = &bP[ scoreEnd + 1 ];
 
-      const size_t horiBeg = xa.hori( k, seq1beg );
-      const size_t vertBeg = xa.vert( k, seq1beg );
-      const size_t diagBeg = xa.diag( k, seq1beg );
-      const double* fD1 = &fD[ horiBeg ];
-      const double* fI1 = &fI[ vertBeg ];
-      const double* fM2 = &fM[ diagBeg ];
-      const double* fP2 = &fP[ diagBeg ];
+      const size_t horiBeg = xa.hori( k, seq1beg ) - base;
+      const size_t vertBeg = xa.vert( k, seq1beg ) - base;
+      const size_t diagBeg = xa.diag( k, seq1beg ) - base;
+      const prob_t* fD1 = &fD[ horiBeg ];
+      const prob_t* fI1 = &fI[ vertBeg ];
+      const prob_t* fM2 = &fM[ diagBeg ];
+      const prob_t* fP2 = &fP[ diagBeg ];
 
-      const double* bM0last = bM0 + xa.numCellsAndPads( k ) - 2;
+      const prob_t* bM0last = bM0 + xa.numCellsAndPads( k ) - 2;
 
       if (! isPssm ) {
 	while (1) { // inner most loop
@@ -830,4 +992,26 @@ namespace cbrc{
       }
     }
   }
+
+  void Centroid::computeExpectedCounts ( const uchar* seq1, const uchar* seq2,
+					 size_t start1, size_t start2,
+					 bool isForward, int globality,
+					 const GeneralizedAffineGapCosts& gap,
+					 ExpectedCount& c ){
+    const Input in = makeInput( seq1, seq2, start1, start2,
+				isForward, globality, gap );
+
+    // After backward, the matrices hold the first segment
+    for( size_t s = 0; s + 1 < segmentBegs.size(); ++s ){
+      if( s > 0 ){
+	double Z = 0.0;  // ignored
+	double scaledUnit = segmentUnits[ s ];
+	initForwardSegment( s );
+	forwardSegment( in, s, Z, false );
+	initBackwardSegment( s );
+	backwardSegment( in, s, scaledUnit, true );
+      }
+      addExpectedCounts( in, s, c );
+    }
+  }
 }  // end namespace cbrc
@@ -31,6 +31,18 @@ namespace cbrc{
    */
   class Centroid{
   public:
+    // The antidiagonals are done in segments, so that the forward
+    // and backward matrices hold at most maxCells cells (or one
+    // antidiagonal, if that is bigger).  For each segment, we keep
+    // the 2 antidiagonals before it (checkpoints), and recompute its
+    // forward values during the backward pass.  The results are
+    // identical whatever maxCells is.
+    enum { defaultMaxCells = 1 << 20 };
+
+    Centroid() : maxCells( defaultMaxCells ) {}
+
+    void setMaxCells( size_t m ) { maxCells = m; }
+
     GappedXdropAligner& aligner() { return xa; }
 
     // Setters
@@ -72,10 +84,12 @@ namespace cbrc{
     double logPartitionFunction() const;  // a.k.a. full score, forward score
 
     // Added by MH (2008/10/10) : compute expected counts for transitions and emissions
+    // Call this after backward, with the same arguments.
     void computeExpectedCounts ( const uchar* seq1, const uchar* seq2,
 				 size_t start1, size_t start2, bool isForward,
+				 int globality,
 				 const GeneralizedAffineGapCosts& gap,
-				 ExpectedCount& count ) const;
+				 ExpectedCount& count );
 
   private:
     typedef double ExpMatrixRow[scoreMatrixRowSize];
@@ -89,7 +103,15 @@ namespace cbrc{
     ExpMatrixRow* pssmExp2; // pre-computed pssm for prob align
     int outputType;
 
-    typedef std::vector< double > dvec_t;
+    // The probabilities are floats if compiled with -DCENTROID_FLOAT:
+    // this is faster, but less accurate (see doc/last.txt)
+#ifdef CENTROID_FLOAT
+    typedef float prob_t;
+#else
+    typedef double prob_t;
+#endif
+
+    typedef std::vector< prob_t > dvec_t;
 
     dvec_t fM; // f^M(i,j)
     dvec_t fD; // f^D(i,j) Ix
@@ -110,18 +132,77 @@ namespace cbrc{
 
     dvec_t X; // DP tables for $gamma$-decoding
 
-    dvec_t scale; // scale[n] is a scaling factor for the n-th anti-diagonal
+    std::vector< double > scale; // scale[n] is a scaling factor for the n-th anti-diagonal
+
+    size_t maxCells;
+    std::vector< size_t > segmentBegs;  // first antidiagonal of each segment, and end
+    std::vector< size_t > checkpointBegs;  // where each segment's checkpoints start
+    dvec_t fCheckpoints;  // fM, fD, fI, fP of the 2 antidiagonals before each segment
+    dvec_t bCheckpoints;  // bM, bD, bI, bP of the 2 antidiagonals before each segment
+    std::vector< double > segmentUnits;  // scaledUnit at the end of each segment
+    dvec_t replayProbs;  // ignored results, when recomputing backward values
+
+    // For the cells of one antidiagonal:
+    dvec_t matchProbs;  // exp(match score / T)
+    dvec_t edgeFlags;  // 1 if next to a delimiter, else 0
+    dvec_t insProbs;  // insertion probabilities, to add to mI
+    dvec_t notProbs2;  // probabilities to subtract from mX2
 
     double bestScore;
     size_t bestAntiDiagonal;
     size_t bestPos1;
 
+    // The inputs of the forward and backward algorithms
+    struct Input {
+      const uchar* seq1;
+      const uchar* seq2;
+      const ExpMatrixRow* pssm;
+      bool isForward;
+      int globality;
+      bool isPair;  // do we need the fP and bP matrices?
+      double eE, eF, eEI, eFI, eP;
+    };
+
+    Input makeInput( const uchar* seq1, const uchar* seq2,
+                     size_t start1, size_t start2, bool isForward,
+                     int globality,
+                     const GeneralizedAffineGapCosts& gap ) const;
+
     void initForwardMatrix();
     void initBackwardMatrix();
     void initDecodingMatrix();
 
     void updateScore( double score, size_t antiDiagonal, size_t cur );
 
+    // Put the match probabilities of an antidiagonal's cells in
+    // matchProbs, and if globality, set edgeFlags
+    void getMatchProbs( const Input& in, size_t seq1beg, size_t seq2pos,
+                        size_t numCells );
+
+    // The index of the first cell of antidiagonal k-2, where the
+    // cells needed for antidiagonals k onwards start.  For k < 2,
+    // this relies on unsigned wraparound.
+    size_t segmentBase( size_t k ) const { return xa.scoreEndIndex( k - 2 ); }
+
+    // Copy the 2 antidiagonals before segment "slot", between 4
+    // matrices holding segment s and a checkpoint store
+    void copyCheckpoint( dvec_t& store, dvec_t& w, dvec_t& x, dvec_t& y,
+                         dvec_t& z, size_t slot, size_t s, bool isToStore );
+
+    void initForwardSegment( size_t s );
+    void initBackwardSegment( size_t s );
+
+    // If !isFirstPass, recompute the values without changing scale
+    void forwardSegment( const Input& in, size_t s, double& Z,
+                         bool isFirstPass );
+
+    // If isReplay, recompute the backward values only
+    void backwardSegment( const Input& in, size_t s, double& scaledUnit,
+                          bool isReplay );
+
+    void addExpectedCounts( const Input& in, size_t s,
+                            ExpectedCount& c ) const;
+
     // start of the x-drop region (i.e. number of skipped seq1 letters
     // before the x-drop region) for this antidiagonal
     size_t seq1start( size_t antidiagonal ) const {
@@ -129,25 +210,25 @@ namespace cbrc{
     }
 
     // get DP matrix value at the given position
-    double cellx( const dvec_t& matrix,
+    prob_t cellx( const dvec_t& matrix,
                   size_t antiDiagonal, size_t seq1pos ) const{
       return matrix[ xa.scoreOrigin( antiDiagonal ) + seq1pos ];
     }
 
     // get DP matrix value "left of" the given position
-    double horix( const dvec_t& matrix,
+    prob_t horix( const dvec_t& matrix,
                   size_t antiDiagonal, size_t seq1pos ) const{
       return matrix[ xa.hori( antiDiagonal, seq1pos ) ];
     }
 
     // get DP matrix value "above" the given position
-    double vertx( const dvec_t& matrix,
+    prob_t vertx( const dvec_t& matrix,
                   size_t antiDiagonal, size_t seq1pos ) const{
       return matrix[ xa.vert( antiDiagonal, seq1pos ) ];
     }
 
     // get DP matrix value "diagonal from" the given position
-    double diagx( const dvec_t& matrix,
+    prob_t diagx( const dvec_t& matrix,
                   size_t antiDiagonal, size_t seq1pos ) const{
       return matrix[ xa.diag( antiDiagonal, seq1pos ) ];
     }
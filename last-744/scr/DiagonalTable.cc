@@ -4,31 +4,55 @@
 
 namespace cbrc{
 
+// Return the slot holding this diagonal, or the empty slot where it
+// would go
+size_t DiagonalTable::find( indexT diagonal ) const{
+  size_t mask = slots.size() - 1;
+  indexT h = diagonal * 2654435761u;  // Knuth's multiplicative hash
+  size_t i = (h ^ (h >> 16)) & mask;  // use the well-mixed high bits too
+  while( slots[i].end && slots[i].diagonal != diagonal ) i = (i + 1) & mask;
+  return i;
+}
+
 bool DiagonalTable::isCovered( indexT sequentialPos, indexT randomPos ){
+  indexT diagonal = sequentialPos - randomPos;  // wrap-around is OK
+  scanPos = sequentialPos;
+  return isLive( slots[ find( diagonal ) ] );
+}
+
+void DiagonalTable::addEndpoint( indexT sequentialPos, indexT randomPos ){
+  if( sequentialPos == 0 ) return;  // can't cover any later position
 
   indexT diagonal = sequentialPos - randomPos;  // wrap-around is OK
-  indexT bin = diagonal % BINS;
-  std::vector<pairT>& v = hits[bin];
-
-  for( std::vector<pairT>::iterator i = v.begin(); i < v.end(); /* noop */ ){
-    if( i->first >= sequentialPos ){
-      if( i->second == diagonal ) return true;
-      ++i;
-    }else{
-      i = v.erase(i);  // hopefully we rarely get here
-    }
+  Slot& s = slots[ find( diagonal ) ];
+  if( s.end ){
+    if( s.end < sequentialPos ) s.end = sequentialPos;
+    return;
   }
 
-  return false;
+  s.diagonal = diagonal;
+  s.end = sequentialPos;
+  if( ++numOfUsedSlots * 2 > slots.size() ) rebuild();
 }
 
-void DiagonalTable::addEndpoint( indexT sequentialPos, indexT randomPos ){
+// Drop the entries behind the scan, and re-hash the others into a
+// table with at most 1/4 of its slots used
+void DiagonalTable::rebuild(){
+  std::vector<Slot> old;
+  old.swap( slots );
 
-  indexT diagonal = sequentialPos - randomPos;  // wrap-around is OK
-  indexT bin = diagonal % BINS;
-  std::vector<pairT>& v = hits[bin];
+  size_t numOfLiveSlots = 0;
+  for( size_t i = 0; i < old.size(); ++i )
+    if( isLive( old[i] ) ) ++numOfLiveSlots;
+
+  size_t newSize = minSize;
+  while( newSize < numOfLiveSlots * 4 ) newSize *= 2;
+  slots.resize( newSize );
+  numOfUsedSlots = numOfLiveSlots;
 
-  v.push_back( pairT( sequentialPos, diagonal ) );
+  for( size_t i = 0; i < old.size(); ++i )
+    if( isLive( old[i] ) )
+      slots[ find( old[i].diagonal ) ] = old[i];
 }
 
 }  // end namespace cbrc
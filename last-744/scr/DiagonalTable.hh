@@ -8,32 +8,62 @@
 // covered so far in each diagonal.  This lets us avoid triggering
 // gapless alignments in places that are already covered.
 
-// Since the number of diagonals may be huge, we map them to a smaller
-// number of bins.  To keep the bin populations small, when checking
-// if a position is covered, we discard information about earlier
-// sequential positions.
+// The diagonals are kept in an open-addressing hash table.  Since we
+// scan sequentially, a diagonal whose furthest position is behind the
+// scan can never cover anything again: such stale entries are dropped
+// when the table fills up, and the table is resized to suit the
+// number of live entries.  So the table stays small even for long
+// sequences, and each operation takes amortized constant time.
 
 #ifndef DIAGONALTABLE_HH
 #define DIAGONALTABLE_HH
-#include <utility>  // pair
+#include <stddef.h>  // size_t
 #include <vector>
 
 namespace cbrc{
 
-struct DiagonalTable{
+class DiagonalTable{
+public:
   typedef unsigned indexT;
-  typedef std::pair<indexT, indexT> pairT;
 
-  enum { BINS = 256 };  // use a power-of-two for faster modulus (maybe)
-                        // 256 is much faster than 65536 in my tests
+  DiagonalTable() : slots( minSize ), numOfUsedSlots( 0 ), scanPos( 0 ) {}
 
   // is this position on this diagonal already covered by an alignment?
+  // The sequential positions must not decrease from call to call.
   bool isCovered( indexT sequentialPos, indexT randomPos );
 
+  // Start a block of sequential positions that may be checked in any
+  // order: they must not be less than blockBeg, nor than the
+  // positions passed to isCovered before.
+  void startBlock( indexT blockBeg ){ scanPos = blockBeg; }
+
+  // is this position on this diagonal already covered, when checking
+  // the positions of a block in any order?
+  bool isCoveredInBlock( indexT sequentialPos, indexT randomPos ) const{
+    const Slot& s = slots[ find( sequentialPos - randomPos ) ];
+    return s.end && s.end >= sequentialPos;
+  }
+
   // add an alignment endpoint to the table:
   void addEndpoint( indexT sequentialPos, indexT randomPos );
 
-  std::vector<pairT> hits[BINS];
+private:
+  struct Slot{
+    indexT diagonal;
+    indexT end;  // furthest covered sequential position, or 0 if empty
+    Slot() : diagonal( 0 ), end( 0 ) {}
+  };
+
+  bool isLive( const Slot& s ) const { return s.end && s.end >= scanPos; }
+
+  enum { minSize = 16 };  // must be a power of two
+
+  std::vector<Slot> slots;
+  size_t numOfUsedSlots;
+  indexT scanPos;  // the latest sequential position passed to isCovered
+
+  size_t find( indexT diagonal ) const;
+  void rebuild();
 };
 
 }  // end namespace cbrc
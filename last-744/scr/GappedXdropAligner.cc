@@ -48,27 +48,39 @@
 
 #include "GappedXdropAligner.hh"
 #include "GappedXdropAlignerInl.hh"
+#include "TwoQualityScoreMatrix.hh"
 //#include <iostream>  // for debugging
 
 namespace cbrc {
 
 // Puts 2 "dummy" antidiagonals at the start, so that we can safely
 // look-back from subsequent antidiagonals.
-void GappedXdropAligner::init() {
+void GappedXdropAligner::init(const ScoreSource &s) {
+  numOfOldCellsAndPads = totalCellsAndPads();
   scoreOrigins.resize(0);
   scoreEnds.resize(1);
+  scoreBase = 0;
+  minScores.clear();
+  checkpoints.clear();
+  checkpointBegs.clear();
+  checkpointScores.clear();
+  source = s;
 
   initAntidiagonal(0, 0, 0);
+  initAntidiagonal(0, 1, 0);
+  initDummyAntidiagonals();
+
+  bestAntidiagonal = 0;
+}
+
+void GappedXdropAligner::initDummyAntidiagonals() {
   xScores[0] = 0;
   yScores[0] = -INF;
   zScores[0] = -INF;
 
-  initAntidiagonal(0, 1, 0);
   xScores[1] = -INF;
   yScores[1] = -INF;
   zScores[1] = -INF;
-
-  bestAntidiagonal = 0;
 }
 
 void GappedXdropAligner::initAntidiagonal(std::size_t seq1beg,
@@ -76,10 +88,146 @@ void GappedXdropAligner::initAntidiagonal(std::size_t seq1beg,
                                           std::size_t numCells) {
   scoreOrigins.push_back(scoreEnd - seq1beg);
   std::size_t newEnd = scoreEnd + numCells + 1;  // + 1 pad cell
-  resizeScoresIfSmaller(newEnd);
+  if (newEnd - scoreBase > maxScoreCells && scoreOrigins.size() > 3)
+    addCheckpoint(scoreOrigins.size() - 3);
+  resizeScoresIfSmaller(newEnd - scoreBase);
   scoreEnds.push_back(newEnd);
 }
 
+void GappedXdropAligner::getShape(std::vector<unsigned> &v) const {
+  v.clear();
+  for (std::size_t k = 2; k < scoreOrigins.size(); ++k) {
+    v.push_back(scoreEnds[k] - scoreOrigins[k]);
+    v.push_back(scoreEnds[k + 1] - scoreEnds[k] - 1);
+  }
+}
+
+void GappedXdropAligner::setShape(const std::vector<unsigned> &v) {
+  unsigned long long oldCells = totalCellsAndPads();
+  scoreOrigins.resize(0);
+  scoreEnds.resize(1);
+  scoreOrigins.push_back(0);  // the dummy antidiagonals, as in init
+  scoreEnds.push_back(1);
+  scoreOrigins.push_back(1);
+  scoreEnds.push_back(2);
+  for (std::size_t i = 0; i < v.size(); i += 2) {
+    std::size_t scoreEnd = scoreEnds.back();
+    scoreOrigins.push_back(scoreEnd - v[i]);
+    scoreEnds.push_back(scoreEnd + v[i + 1] + 1);  // + 1 pad cell
+  }
+  numOfOldCellsAndPads = oldCells - scoreEnds.back();  // no cells computed
+}
+
+// Discard the scores before the 2 antidiagonals preceding this one,
+// and save those 2 antidiagonals, so we can restart from them
+void GappedXdropAligner::addCheckpoint(std::size_t antidiagonal) {
+  std::size_t beg = scoreEnds[antidiagonal] - scoreBase;
+  std::size_t end = scoreEnds[antidiagonal + 2] - scoreBase;
+  checkpoints.push_back(antidiagonal);
+  checkpointBegs.push_back(checkpointScores.size());
+  checkpointScores.insert(checkpointScores.end(),
+			  xScores.begin() + beg, xScores.begin() + end);
+  checkpointScores.insert(checkpointScores.end(),
+			  yScores.begin() + beg, yScores.begin() + end);
+  checkpointScores.insert(checkpointScores.end(),
+			  zScores.begin() + beg, zScores.begin() + end);
+  std::copy(xScores.begin() + beg, xScores.begin() + end, xScores.begin());
+  std::copy(yScores.begin() + beg, yScores.begin() + end, yScores.begin());
+  std::copy(zScores.begin() + beg, zScores.begin() + end, zScores.begin());
+  scoreBase += beg;
+}
+
+// Recompute the scores of the antidiagonals before this one, back to
+// the nearest checkpoint, so that the trace-back can look back from it
+void GappedXdropAligner::recomputeScores(std::size_t antidiagonal) {
+  std::size_t n = std::upper_bound(checkpoints.begin(), checkpoints.end(),
+				   antidiagonal) - checkpoints.begin();
+  std::size_t k = 0;
+  if (n) {
+    k = checkpoints[n - 1];
+    scoreBase = scoreEnds[k];
+    std::size_t size = scoreEnds[k + 2] - scoreBase;
+    std::vector<int>::const_iterator c =
+      checkpointScores.begin() + checkpointBegs[n - 1];
+    std::copy(c, c + size, xScores.begin());
+    std::copy(c + size, c + size * 2, yScores.begin());
+    std::copy(c + size * 2, c + size * 3, zScores.begin());
+  } else {
+    scoreBase = 0;
+    initDummyAntidiagonals();
+  }
+
+  resizeScoresIfSmaller(scoreEnds[antidiagonal + 2] - scoreBase);
+
+  for (; k < antidiagonal; ++k) {
+    std::size_t scoreEnd = scoreEnds[k + 2];
+    std::size_t numCells = scoreEnds[k + 3] - scoreEnd - 1;
+    std::size_t seq1beg = scoreEnd - scoreOrigins[k + 2];
+
+    int *x0 = &xScores[scoreEnd - scoreBase];
+    int *y0 = &yScores[scoreEnd - scoreBase];
+    int *z0 = &zScores[scoreEnd - scoreBase];
+    const int *y1 = &yScores[hori(k, seq1beg) - scoreBase];
+    const int *z1 = &zScores[vert(k, seq1beg) - scoreBase];
+    const int *x2 = &xScores[diag(k, seq1beg) - scoreBase];
+
+    *x0++ = *y0++ = *z0++ = -INF;  // add one pad cell
+
+    calcMatchScores(k, seq1beg, numCells);
+
+    const ScoreSource &s = source;
+    std::size_t bestIndex = 0;
+    int bestScore = INF;  // we don't need the best score
+    if (s.isAffine) {
+      affineCells(x0, y0, z0, x2, y1, z1, &matchScores[0], numCells,
+		  s.delExistenceCost, s.delExtensionCost, minScores[k],
+		  bestScore, bestIndex);
+    } else {
+      const int *y2 = &yScores[diag(k, seq1beg) - scoreBase];
+      const int *z2 = &zScores[diag(k, seq1beg) - scoreBase];
+      generalizedAffineCells(x0, y0, z0, x2, y1, z1, y2, z2,
+			     &matchScores[0], numCells,
+			     s.delExistenceCost, s.delExtensionCost,
+			     s.insExistenceCost, s.insExtensionCost,
+			     s.gapUnalignedCost, minScores[k],
+			     bestScore, bestIndex);
+    }
+  }
+}
+
+void GappedXdropAligner::calcMatchScores(std::size_t antidiagonal,
+					 std::size_t seq1beg,
+					 std::size_t numCells) {
+  const ScoreSource &s = source;
+  std::size_t seq2pos = antidiagonal - seq1beg;
+  std::ptrdiff_t step = s.isForward ? 1 : -1;
+  std::ptrdiff_t beg1 = s.isForward ? seq1beg : -1 - std::ptrdiff_t(seq1beg);
+  std::ptrdiff_t beg2 = s.isForward ? seq2pos : -1 - std::ptrdiff_t(seq2pos);
+  const uchar *s1 = s.seq1 + beg1;
+  int *m = matchScoresBuffer(numCells);
+  int *mEnd = m + numCells;
+
+  switch (s.type) {
+  case matrixScorer:
+    for (const uchar *s2 = s.seq2 + beg2; m < mEnd; s1 += step, s2 -= step)
+      *m++ = s.scorer[*s1][*s2];
+    break;
+  case pssmScorer:
+    for (const ScoreMatrixRow *s2 = s.scorer + beg2; m < mEnd;
+	 s1 += step, s2 -= step)
+      *m++ = (*s2)[*s1];
+    break;
+  case twoQualityScorer: {
+    const uchar *q1 = s.qual1 + beg1;
+    const uchar *s2 = s.seq2 + beg2;
+    const uchar *q2 = s.qual2 + beg2;
+    for (; m < mEnd; s1 += step, q1 += step, s2 -= step, q2 -= step)
+      *m++ = (*s.qualityScorer)(*s1, *s2, *q1, *q2);
+    break;
+  }
+  }
+}
+
 int GappedXdropAligner::align(const uchar *seq1,
                               const uchar *seq2,
                               bool isForward,
@@ -105,7 +253,11 @@ int GappedXdropAligner::align(const uchar *seq1,
   std::size_t bestEdgeAntidiagonal = 0;
   std::size_t bestEdgeSeq1position = 0;
 
-  init();
+  ScoreSource src = { matrixScorer, seq1, 0, seq2, 0, scorer, 0,
+		      isForward, isAffine,
+		      delExistenceCost, delExtensionCost,
+		      insExistenceCost, insExtensionCost, gapUnalignedCost };
+  init(src);
 
   for (std::size_t antidiagonal = 0; /* noop */; ++antidiagonal) {
     std::size_t seq1beg = std::min(maxSeq1begs[0], maxSeq1begs[1]);
@@ -127,88 +279,64 @@ int GappedXdropAligner::align(const uchar *seq1,
       updateMaxScoreDrop(maxScoreDrop, numCells, maxMatchScore);
 
     int minScore = bestScore - maxScoreDrop;
+    minScores.push_back(minScore);
 
-    int *x0 = &xScores[scoreEnd];
-    int *y0 = &yScores[scoreEnd];
-    int *z0 = &zScores[scoreEnd];
-    const int *y1 = &yScores[hori(antidiagonal, seq1beg)];
-    const int *z1 = &zScores[vert(antidiagonal, seq1beg)];
-    const int *x2 = &xScores[diag(antidiagonal, seq1beg)];
-
-    const int *x0last = x0 + numCells;
+    int *x0 = &xScores[scoreEnd - scoreBase];
+    int *y0 = &yScores[scoreEnd - scoreBase];
+    int *z0 = &zScores[scoreEnd - scoreBase];
+    const int *y1 = &yScores[hori(antidiagonal, seq1beg) - scoreBase];
+    const int *z1 = &zScores[vert(antidiagonal, seq1beg) - scoreBase];
+    const int *x2 = &xScores[diag(antidiagonal, seq1beg) - scoreBase];
 
     *x0++ = *y0++ = *z0++ = -INF;  // add one pad cell
 
     const int *x0base = x0 - seq1beg;
 
     if (globality && isDelimiter(*s2, *scorer)) {
-      const int *z2 = &zScores[diag(antidiagonal, seq1beg)];
+      const int *z2 = &zScores[diag(antidiagonal, seq1beg) - scoreBase];
       int b = maxValue(*x2, *z1 - insExtensionCost, *z2 - gapUnalignedCost);
       if (b >= minScore)
 	updateBest1(bestEdgeScore, bestEdgeAntidiagonal, bestEdgeSeq1position,
 		    b, antidiagonal, seq1beg);
     }
 
+    int *m = matchScoresBuffer(numCells);
+    const int *mLast = m + numCells - 1;
+    while (1) {
+      *m = scorer[*s1][*s2];
+      if (m == mLast) break;
+      ++m;
+      if (isForward) { ++s1;  --s2; }
+      else           { --s1;  ++s2; }
+    }
+
+    std::size_t bestIndex = 0;
+    int newBest = bestScore;
     if (isAffine) {
-      // We could avoid this code duplication, by using: transposed(scorer).
-      if (isForward)
-        while (1) {
-          int x = *x2;
-          int y = *y1 - delExtensionCost;
-          int z = *z1 - delExtensionCost;
-          int b = maxValue(x, y, z);
-          if (b >= minScore) {
-            updateBest(bestScore, b, antidiagonal, x0, x0base);
-            *x0 = b + scorer[*s1][*s2];
-            int g = b - delExistenceCost;
-            *y0 = maxValue(g, y);
-            *z0 = maxValue(g, z);
-          }
-          else *x0 = *y0 = *z0 = -INF;
-          if (x0 == x0last) break;
-          ++s1;  --s2;  ++x0;  ++y0;  ++z0;  ++y1;  ++z1;  ++x2;
-        }
-      else
-        while (1) {
-          int x = *x2;
-          int y = *y1 - delExtensionCost;
-          int z = *z1 - delExtensionCost;
-          int b = maxValue(x, y, z);
-          if (b >= minScore) {
-            updateBest(bestScore, b, antidiagonal, x0, x0base);
-            *x0 = b + scorer[*s1][*s2];
-            int g = b - delExistenceCost;
-            *y0 = maxValue(g, y);
-            *z0 = maxValue(g, z);
-          }
-          else *x0 = *y0 = *z0 = -INF;
-          if (x0 == x0last) break;
-          --s1;  ++s2;  ++x0;  ++y0;  ++z0;  ++y1;  ++z1;  ++x2;
-        }
+      affineCells(x0, y0, z0, x2, y1, z1, &matchScores[0], numCells,
+		  delExistenceCost, delExtensionCost, minScore, newBest, bestIndex);
     } else {
-      const int *y2 = &yScores[diag(antidiagonal, seq1beg)];
-      const int *z2 = &zScores[diag(antidiagonal, seq1beg)];
-      while (1) {
-        int x = *x2;
-        int y = maxValue(*y1 - delExtensionCost, *y2 - gapUnalignedCost);
-        int z = maxValue(*z1 - insExtensionCost, *z2 - gapUnalignedCost);
-        int b = maxValue(x, y, z);
-        if (b >= minScore) {
-          updateBest(bestScore, b, antidiagonal, x0, x0base);
-          *x0 = b + scorer[*s1][*s2];
-          *y0 = maxValue(b - delExistenceCost, y);
-          *z0 = maxValue(b - insExistenceCost, z);
-        }
-        else *x0 = *y0 = *z0 = -INF;
-        if (x0 == x0last) break;
-        ++x0;  ++y0;  ++z0;  ++y1;  ++z1;  ++x2;  ++y2;  ++z2;
-        if (isForward) { ++s1;  --s2; }
-        else           { --s1;  ++s2; }
-      }
+      const int *y2 = &yScores[diag(antidiagonal, seq1beg) - scoreBase];
+      const int *z2 = &zScores[diag(antidiagonal, seq1beg) - scoreBase];
+      generalizedAffineCells(x0, y0, z0, x2, y1, z1, y2, z2,
+			     &matchScores[0], numCells,
+			     delExistenceCost, delExtensionCost,
+			     insExistenceCost, insExtensionCost,
+			     gapUnalignedCost, minScore, newBest, bestIndex);
+    }
+    if (newBest > bestScore) {
+      bestScore = newBest;
+      bestAntidiagonal = antidiagonal;
+      bestSeq1position = seq1beg + bestIndex;
     }
 
+    // point at the last cell
+    x0 += numCells - 1;
+    y1 += numCells - 1;
+    x2 += numCells - 1;
+
     if (globality && isDelimiter(*s1, *scorer)) {
-      const int *y2 = &yScores[diag(antidiagonal, seq1end-1)];
+      const int *y2 = &yScores[diag(antidiagonal, seq1end-1) - scoreBase];
       int b = maxValue(*x2, *y1 - delExtensionCost, *y2 - gapUnalignedCost);
       if (b >= minScore)
 	updateBest1(bestEdgeScore, bestEdgeAntidiagonal, bestEdgeSeq1position,
@@ -249,9 +377,12 @@ bool GappedXdropAligner::getNextChunk(std::size_t &end1,
   while (1) {
     assert(bestSeq1position <= bestAntidiagonal);
 
-    std::size_t h = hori(bestAntidiagonal, bestSeq1position);
-    std::size_t v = vert(bestAntidiagonal, bestSeq1position);
-    std::size_t d = diag(bestAntidiagonal, bestSeq1position);
+    if (scoreEnds[bestAntidiagonal] < scoreBase)
+      recomputeScores(bestAntidiagonal);
+
+    std::size_t h = hori(bestAntidiagonal, bestSeq1position) - scoreBase;
+    std::size_t v = vert(bestAntidiagonal, bestSeq1position) - scoreBase;
+    std::size_t d = diag(bestAntidiagonal, bestSeq1position) - scoreBase;
 
     int x = xScores[d];
     int y = yScores[h] - delExtensionCost;
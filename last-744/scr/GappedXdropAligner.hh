@@ -43,6 +43,13 @@
 // too-high value, the results will not change, but the run time may
 // increase.
 
+// The scores are stored for the trace-back.  To bound the memory,
+// only about maxScoreCells of them are kept: when there are more, the
+// oldest antidiagonals are discarded, but 2 antidiagonals are kept as
+// a checkpoint.  The trace-back recomputes the scores from the
+// checkpoints, so the alignments are the same, but long alignments
+// take more time.  (This is not done for 3-frame alignment.)
+
 #ifndef GAPPED_XDROP_ALIGNER_HH
 #define GAPPED_XDROP_ALIGNER_HH
 
@@ -59,6 +66,15 @@ class TwoQualityScoreMatrix;
 
 class GappedXdropAligner {
  public:
+  enum { defaultMaxScoreCells = 1 << 22 };
+
+  GappedXdropAligner()
+    : numOfOldCellsAndPads(0), maxScoreCells(defaultMaxScoreCells),
+      scoreBase(0) {}
+
+  // Keep about this many scores for the trace-back (see above)
+  void setMaxScoreCells(std::size_t n) { maxScoreCells = n; }
+
   int align(const uchar *seq1,  // start point in the 1st sequence
             const uchar *seq2,  // start point in the 2nd sequence
             bool isForward,  // forward or reverse extension?
@@ -175,9 +191,24 @@ class GappedXdropAligner {
   std::size_t numCellsAndPads(std::size_t antidiagonal) const
   { return scoreEnds[antidiagonal + 3] - scoreEnds[antidiagonal + 2]; }
 
+  // The number of cells (including pad cells) computed by all the
+  // alignments so far, for statistics.
+  unsigned long long totalCellsAndPads() const
+  { return numOfOldCellsAndPads + (scoreEnds.empty() ? 0 : scoreEnds.back()); }
+
   std::size_t scoreEndIndex(std::size_t antidiagonal) const
   { return scoreEnds[antidiagonal + 2]; }
 
+  // Set v to the shape of the latest alignment's antidiagonals: the
+  // first seq1 coordinate, and the number of cells, of each one.
+  void getShape(std::vector<unsigned> &v) const;
+
+  // Make the antidiagonals have this shape (from getShape), without
+  // any scores.  This is enough for Centroid, so it can re-use an
+  // alignment's shape without redoing the alignment.  getNextChunk
+  // must not be called after this.
+  void setShape(const std::vector<unsigned> &v);
+
   // The index in the score vectors, of the previous "horizontal" cell.
   std::size_t hori(std::size_t antidiagonal, std::size_t seq1coordinate) const
   { return scoreOrigins[antidiagonal + 1] + seq1coordinate; }
@@ -207,8 +238,38 @@ class GappedXdropAligner {
   std::vector<int> yScores;  // best score ending with insertion in seq1
   std::vector<int> zScores;  // best score ending with insertion in seq2
 
+  std::vector<int> matchScores;  // match scores for one antidiagonal
+
   std::vector<std::size_t> scoreOrigins;  // score origin for each antidiagonal
   std::vector<std::size_t> scoreEnds;  // score end pos for each antidiagonal
+  unsigned long long numOfOldCellsAndPads;  // in previous alignments
+
+  std::size_t maxScoreCells;
+  std::size_t scoreBase;  // index i is stored at xScores[i - scoreBase]
+  std::vector<int> minScores;  // the X-drop limit for each antidiagonal
+  std::vector<std::size_t> checkpoints;  // antidiagonals we can restart at
+  std::vector<std::size_t> checkpointBegs;  // where each one's scores are
+  std::vector<int> checkpointScores;
+
+  // What we need to recompute the scores
+  enum ScorerType { matrixScorer, pssmScorer, twoQualityScorer };
+  struct ScoreSource {
+    ScorerType type;
+    const uchar *seq1;
+    const uchar *qual1;
+    const uchar *seq2;
+    const uchar *qual2;
+    const ScoreMatrixRow *scorer;  // the score matrix or PSSM
+    const TwoQualityScoreMatrix *qualityScorer;
+    bool isForward;
+    bool isAffine;
+    int delExistenceCost;
+    int delExtensionCost;
+    int insExistenceCost;
+    int insExtensionCost;
+    int gapUnalignedCost;
+  };
+  ScoreSource source;
 
   // Our position during the trace-back:
   std::size_t bestAntidiagonal;
@@ -222,11 +283,25 @@ class GappedXdropAligner {
     }
   }
 
-  void init();
+  int *matchScoresBuffer(std::size_t numCells) {
+    if (matchScores.size() < numCells) matchScores.resize(numCells);
+    return &matchScores[0];
+  }
+
+  void init(const ScoreSource &s);
+
+  void initDummyAntidiagonals();
 
   void initAntidiagonal(std::size_t seq1beg, std::size_t scoreEnd,
                         std::size_t numCells);
 
+  void addCheckpoint(std::size_t antidiagonal);
+
+  void recomputeScores(std::size_t antidiagonal);
+
+  void calcMatchScores(std::size_t antidiagonal, std::size_t seq1beg,
+		       std::size_t numCells);
+
   void updateBest(int &bestScore, int score, std::size_t antidiagonal,
                   const int *x0, const int *x0ori);
 
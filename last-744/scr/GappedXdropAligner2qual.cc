@@ -37,7 +37,11 @@ int GappedXdropAligner::align2qual(const uchar *seq1,
   std::size_t bestEdgeAntidiagonal = 0;
   std::size_t bestEdgeSeq1position = 0;
 
-  init();
+  ScoreSource src = { twoQualityScorer, seq1, qual1, seq2, qual2, 0, &scorer,
+		      isForward, isAffine,
+		      delExistenceCost, delExtensionCost,
+		      insExistenceCost, insExtensionCost, gapUnalignedCost };
+  init(src);
 
   for (std::size_t antidiagonal = 0; /* noop */; ++antidiagonal) {
     std::size_t seq1beg = std::min(maxSeq1begs[0], maxSeq1begs[1]);
@@ -61,87 +65,64 @@ int GappedXdropAligner::align2qual(const uchar *seq1,
       updateMaxScoreDrop(maxScoreDrop, numCells, maxMatchScore);
 
     int minScore = bestScore - maxScoreDrop;
+    minScores.push_back(minScore);
 
-    int *x0 = &xScores[scoreEnd];
-    int *y0 = &yScores[scoreEnd];
-    int *z0 = &zScores[scoreEnd];
-    const int *y1 = &yScores[hori(antidiagonal, seq1beg)];
-    const int *z1 = &zScores[vert(antidiagonal, seq1beg)];
-    const int *x2 = &xScores[diag(antidiagonal, seq1beg)];
-
-    const int *x0last = x0 + numCells;
+    int *x0 = &xScores[scoreEnd - scoreBase];
+    int *y0 = &yScores[scoreEnd - scoreBase];
+    int *z0 = &zScores[scoreEnd - scoreBase];
+    const int *y1 = &yScores[hori(antidiagonal, seq1beg) - scoreBase];
+    const int *z1 = &zScores[vert(antidiagonal, seq1beg) - scoreBase];
+    const int *x2 = &xScores[diag(antidiagonal, seq1beg) - scoreBase];
 
     *x0++ = *y0++ = *z0++ = -INF;  // add one pad cell
 
     const int *x0base = x0 - seq1beg;
 
     if (globality && isDelimiter2qual(*s2)) {
-      const int *z2 = &zScores[diag(antidiagonal, seq1beg)];
+      const int *z2 = &zScores[diag(antidiagonal, seq1beg) - scoreBase];
       int b = maxValue(*x2, *z1 - insExtensionCost, *z2 - gapUnalignedCost);
       if (b >= minScore)
 	updateBest1(bestEdgeScore, bestEdgeAntidiagonal, bestEdgeSeq1position,
 		    b, antidiagonal, seq1beg);
     }
 
+    int *m = matchScoresBuffer(numCells);
+    const int *mLast = m + numCells - 1;
+    while (1) {
+      *m = scorer(*s1, *s2, *q1, *q2);
+      if (m == mLast) break;
+      ++m;
+      if (isForward) { ++s1;  ++q1;  --s2;  --q2; }
+      else           { --s1;  --q1;  ++s2;  ++q2; }
+    }
+
+    std::size_t bestIndex = 0;
+    int newBest = bestScore;
     if (isAffine) {
-      if (isForward)
-        while (1) {
-          int x = *x2;
-          int y = *y1 - delExtensionCost;
-          int z = *z1 - delExtensionCost;
-          int b = maxValue(x, y, z);
-          if (b >= minScore) {
-            updateBest(bestScore, b, antidiagonal, x0, x0base);
-            *x0 = b + scorer(*s1, *s2, *q1, *q2);
-            int g = b - delExistenceCost;
-            *y0 = maxValue(g, y);
-            *z0 = maxValue(g, z);
-          }
-          else *x0 = *y0 = *z0 = -INF;
-          if (x0 == x0last) break;
-          ++s1;  ++q1;  --s2;  --q2;  ++x0;  ++y0;  ++z0;  ++y1;  ++z1;  ++x2;
-        }
-      else
-        while (1) {
-          int x = *x2;
-          int y = *y1 - delExtensionCost;
-          int z = *z1 - delExtensionCost;
-          int b = maxValue(x, y, z);
-          if (b >= minScore) {
-            updateBest(bestScore, b, antidiagonal, x0, x0base);
-            *x0 = b + scorer(*s1, *s2, *q1, *q2);
-            int g = b - delExistenceCost;
-            *y0 = maxValue(g, y);
-            *z0 = maxValue(g, z);
-          }
-          else *x0 = *y0 = *z0 = -INF;
-          if (x0 == x0last) break;
-          --s1;  --q1;  ++s2;  ++q2;  ++x0;  ++y0;  ++z0;  ++y1;  ++z1;  ++x2;
-        }
+      affineCells(x0, y0, z0, x2, y1, z1, &matchScores[0], numCells,
+		  delExistenceCost, delExtensionCost, minScore, newBest, bestIndex);
     } else {
-      const int *y2 = &yScores[diag(antidiagonal, seq1beg)];
-      const int *z2 = &zScores[diag(antidiagonal, seq1beg)];
-      while (1) {
-        int x = *x2;
-        int y = maxValue(*y1 - delExtensionCost, *y2 - gapUnalignedCost);
-        int z = maxValue(*z1 - insExtensionCost, *z2 - gapUnalignedCost);
-        int b = maxValue(x, y, z);
-        if (b >= minScore) {
-          updateBest(bestScore, b, antidiagonal, x0, x0base);
-          *x0 = b + scorer(*s1, *s2, *q1, *q2);
-          *y0 = maxValue(b - delExistenceCost, y);
-          *z0 = maxValue(b - insExistenceCost, z);
-        }
-        else *x0 = *y0 = *z0 = -INF;
-        if (x0 == x0last) break;
-        ++x0;  ++y0;  ++z0;  ++y1;  ++z1;  ++x2;  ++y2;  ++z2;
-        if (isForward) { ++s1;  ++q1;  --s2;  --q2; }
-        else           { --s1;  --q1;  ++s2;  ++q2; }
-      }
+      const int *y2 = &yScores[diag(antidiagonal, seq1beg) - scoreBase];
+      const int *z2 = &zScores[diag(antidiagonal, seq1beg) - scoreBase];
+      generalizedAffineCells(x0, y0, z0, x2, y1, z1, y2, z2,
+			     &matchScores[0], numCells,
+			     delExistenceCost, delExtensionCost,
+			     insExistenceCost, insExtensionCost,
+			     gapUnalignedCost, minScore, newBest, bestIndex);
     }
+    if (newBest > bestScore) {
+      bestScore = newBest;
+      bestAntidiagonal = antidiagonal;
+      bestSeq1position = seq1beg + bestIndex;
+    }
+
+    // point at the last cell
+    x0 += numCells - 1;
+    y1 += numCells - 1;
+    x2 += numCells - 1;
 
     if (globality && isDelimiter2qual(*s1)) {
-      const int *y2 = &yScores[diag(antidiagonal, seq1end-1)];
+      const int *y2 = &yScores[diag(antidiagonal, seq1end-1) - scoreBase];
       int b = maxValue(*x2, *y1 - delExtensionCost, *y2 - gapUnalignedCost);
       if (b >= minScore)
 	updateBest1(bestEdgeScore, bestEdgeAntidiagonal, bestEdgeSeq1position,
@@ -59,8 +59,10 @@ namespace cbrc {
 // Puts 7 "dummy" antidiagonals at the start, so that we can safely
 // look-back from subsequent antidiagonals.
 void GappedXdropAligner::init3() {
+  numOfOldCellsAndPads = totalCellsAndPads();
   scoreOrigins.resize(0);
   scoreEnds.resize(1);
+  scoreBase = 0;  // 3-frame alignment keeps all the scores
 
   initAntidiagonal3(0, 0, 0);
   initAntidiagonal3(0, 2, 0);
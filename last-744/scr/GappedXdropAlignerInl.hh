@@ -3,6 +3,8 @@
 #ifndef GAPPED_XDROP_ALIGNER_INL_HH
 #define GAPPED_XDROP_ALIGNER_INL_HH
 
+#include "simd.hh"
+
 #include <algorithm>
 #include <cassert>
 //#include <stdexcept>
@@ -110,6 +112,143 @@ inline void GappedXdropAligner::updateBest(int &bestScore, int score,
   }
 }
 
+#ifdef SIMD_LEN
+// If any lane of bValues exceeds bestScore, set bestScore to the
+// highest one, and bestIndex to its first index
+inline void updateBestFromLanes(int &bestScore, std::size_t &bestIndex,
+				SimdInt bValues, SimdInt bIndexes) {
+  int values[SIMD_LEN];
+  int indexes[SIMD_LEN];
+  simdStore(values, bValues);
+  simdStore(indexes, bIndexes);
+  int m = arrayMax(values);
+  if (m <= bestScore) return;
+  bestScore = m;
+  bestIndex = -1;
+  for (int i = 0; i < SIMD_LEN; ++i)
+    if (values[i] == m)
+      bestIndex = std::min(bestIndex, static_cast<std::size_t>(indexes[i]));
+}
+#endif
+
+// Calculate the x, y, z scores of the cells in one antidiagonal, for
+// standard affine gap costs, given the match score of each cell.  If
+// any cell's "b" score exceeds bestScore, set bestScore to the
+// highest one, and bestIndex to the first cell with it.  The results
+// are identical with or without SIMD.
+inline void affineCells(int *x0, int *y0, int *z0,
+			const int *x2, const int *y1, const int *z1,
+			const int *matchScores, std::size_t numCells,
+			int gapExistenceCost, int gapExtensionCost,
+			int minScore, int &bestScore, std::size_t &bestIndex) {
+  std::size_t i = 0;
+#ifdef SIMD_LEN
+  const SimdInt mInf = simdFill(-INF);
+  const SimdInt mMin = simdFill(minScore);
+  const SimdInt mExist = simdFill(gapExistenceCost);
+  const SimdInt mExtend = simdFill(gapExtensionCost);
+  const SimdInt mStep = simdFill(SIMD_LEN);
+  SimdInt bIndex = simdIndexes();
+  SimdInt bestValues = simdFill(bestScore);
+  SimdInt bestIndexes = simdFill(0);
+  for (; i + SIMD_LEN <= numCells; i += SIMD_LEN) {
+    SimdInt x = simdLoad(x2 + i);
+    SimdInt y = simdSub(simdLoad(y1 + i), mExtend);
+    SimdInt z = simdSub(simdLoad(z1 + i), mExtend);
+    SimdInt b = simdMax(simdMax(x, y), z);
+    SimdInt isDrop = simdGt(mMin, b);
+    SimdInt g = simdSub(b, mExist);
+    simdStore(x0 + i,
+	      simdBlend(simdAdd(b, simdLoad(matchScores + i)), mInf, isDrop));
+    simdStore(y0 + i, simdBlend(simdMax(g, y), mInf, isDrop));
+    simdStore(z0 + i, simdBlend(simdMax(g, z), mInf, isDrop));
+    SimdInt isBest = simdGt(b, bestValues);
+    bestValues = simdBlend(bestValues, b, isBest);
+    bestIndexes = simdBlend(bestIndexes, bIndex, isBest);
+    bIndex = simdAdd(bIndex, mStep);
+  }
+  updateBestFromLanes(bestScore, bestIndex, bestValues, bestIndexes);
+#endif
+  for (; i < numCells; ++i) {
+    int x = x2[i];
+    int y = y1[i] - gapExtensionCost;
+    int z = z1[i] - gapExtensionCost;
+    int b = maxValue(x, y, z);
+    if (b >= minScore) {
+      if (b > bestScore) {
+	bestScore = b;
+	bestIndex = i;
+      }
+      x0[i] = b + matchScores[i];
+      int g = b - gapExistenceCost;
+      y0[i] = maxValue(g, y);
+      z0[i] = maxValue(g, z);
+    }
+    else x0[i] = y0[i] = z0[i] = -INF;
+  }
+}
+
+// Like affineCells, but for generalized affine gap costs
+inline void generalizedAffineCells(int *x0, int *y0, int *z0,
+				   const int *x2, const int *y1, const int *z1,
+				   const int *y2, const int *z2,
+				   const int *matchScores, std::size_t numCells,
+				   int delExistenceCost, int delExtensionCost,
+				   int insExistenceCost, int insExtensionCost,
+				   int gapUnalignedCost, int minScore,
+				   int &bestScore, std::size_t &bestIndex) {
+  std::size_t i = 0;
+#ifdef SIMD_LEN
+  const SimdInt mInf = simdFill(-INF);
+  const SimdInt mMin = simdFill(minScore);
+  const SimdInt mDelExist = simdFill(delExistenceCost);
+  const SimdInt mDelExtend = simdFill(delExtensionCost);
+  const SimdInt mInsExist = simdFill(insExistenceCost);
+  const SimdInt mInsExtend = simdFill(insExtensionCost);
+  const SimdInt mUnaligned = simdFill(gapUnalignedCost);
+  const SimdInt mStep = simdFill(SIMD_LEN);
+  SimdInt bIndex = simdIndexes();
+  SimdInt bestValues = simdFill(bestScore);
+  SimdInt bestIndexes = simdFill(0);
+  for (; i + SIMD_LEN <= numCells; i += SIMD_LEN) {
+    SimdInt x = simdLoad(x2 + i);
+    SimdInt y = simdMax(simdSub(simdLoad(y1 + i), mDelExtend),
+			simdSub(simdLoad(y2 + i), mUnaligned));
+    SimdInt z = simdMax(simdSub(simdLoad(z1 + i), mInsExtend),
+			simdSub(simdLoad(z2 + i), mUnaligned));
+    SimdInt b = simdMax(simdMax(x, y), z);
+    SimdInt isDrop = simdGt(mMin, b);
+    simdStore(x0 + i,
+	      simdBlend(simdAdd(b, simdLoad(matchScores + i)), mInf, isDrop));
+    simdStore(y0 + i,
+	      simdBlend(simdMax(simdSub(b, mDelExist), y), mInf, isDrop));
+    simdStore(z0 + i,
+	      simdBlend(simdMax(simdSub(b, mInsExist), z), mInf, isDrop));
+    SimdInt isBest = simdGt(b, bestValues);
+    bestValues = simdBlend(bestValues, b, isBest);
+    bestIndexes = simdBlend(bestIndexes, bIndex, isBest);
+    bIndex = simdAdd(bIndex, mStep);
+  }
+  updateBestFromLanes(bestScore, bestIndex, bestValues, bestIndexes);
+#endif
+  for (; i < numCells; ++i) {
+    int x = x2[i];
+    int y = maxValue(y1[i] - delExtensionCost, y2[i] - gapUnalignedCost);
+    int z = maxValue(z1[i] - insExtensionCost, z2[i] - gapUnalignedCost);
+    int b = maxValue(x, y, z);
+    if (b >= minScore) {
+      if (b > bestScore) {
+	bestScore = b;
+	bestIndex = i;
+      }
+      x0[i] = b + matchScores[i];
+      y0[i] = maxValue(b - delExistenceCost, y);
+      z0[i] = maxValue(b - insExistenceCost, z);
+    }
+    else x0[i] = y0[i] = z0[i] = -INF;
+  }
+}
+
 inline void updateMaxScoreDrop(int &maxScoreDrop,
                                std::size_t numCells, int maxMatchScore) {
   // If the current antidiagonal touches a sentinel/delimiter, then
@@ -2,7 +2,7 @@
 
 #include "LastalArguments.hh"
 #include "stringify.hh"
-#include <unistd.h>  // getopt
+#include <getopt.h>  // getopt_long
 #include <algorithm>  // max
 #include <iostream>
 #include <sstream>
@@ -19,13 +19,33 @@ static void badopt( char opt, const char* arg ){
   ERR( std::string("bad option value: -") + opt + ' ' + arg );
 }
 
+// These options apply to the whole run, so they can't be given per
+// database
+static void checkNotExtraDatabase( const char* opt, bool isExtraDatabase ){
+  if( isExtraDatabase )
+    ERR( std::string("can't use option ") + opt + " in --database" );
+}
+
+// long options that have no one-letter equivalent:
+enum { optDatabase = 256, optFilter, optCullOverlap, optBestPerQuery,
+       optWatch, optStats, optChain, optSortHits };
+
+static const struct option longOptions[] = {
+  { "help",     no_argument,       0, 'h' },
+  { "version",  no_argument,       0, 'V' },
+  { "database", required_argument, 0, optDatabase },
+  { "filter",   required_argument, 0, optFilter },
+  { "cull-overlap", required_argument, 0, optCullOverlap },
+  { "best-per-query", required_argument, 0, optBestPerQuery },
+  { "watch",    required_argument, 0, optWatch },
+  { "stats",    required_argument, 0, optStats },
+  { "chain",    required_argument, 0, optChain },
+  { "sort-hits", required_argument, 0, optSortHits },
+  { 0, 0, 0, 0 }
+};
+
 static int myGetopt( int argc, char** argv, const char* optstring ){
-  if( optind < argc ){
-    std::string nextarg = argv[optind];
-    if( nextarg == "--help"    ) return 'h';
-    if( nextarg == "--version" ) return 'V';
-  }
-  return getopt( argc, argv, optstring );
+  return getopt_long( argc, argv, optstring, longOptions, 0 );
 }
 
 static char parseOutputFormat( const char* text ){
@@ -75,17 +95,25 @@ LastalArguments::LastalArguments() :
   maxGaplessAlignmentsPerQueryPosition(0),  // depends on oneHitMultiplicity
   cullingLimitForGaplessAlignments(0),
   cullingLimitForFinalAlignments(0),
+  cullingOverlapFraction(0),
+  maxAlignmentsPerQuery(0),
   queryStep(1),
   minimizerWindow(0),  // depends on the reference's minimizer window
   batchSize(0),  // depends on the outputType, and voluming
   numOfThreads(1),
   maxRepeatDistance(1000),  // sufficiently conservative?
+  maxChainDistance(0),  // this means: OFF
+  sortedHitBlock(0),  // this means: OFF
   temperature(-1),  // depends on the score matrix
   gamma(1),
   geneticCodeFile(""),
+  alignmentFilter(""),
+  watchDirectory(""),
+  statsFile(""),
   verbosity(0){}
 
-void LastalArguments::fromArgs( int argc, char** argv, bool optionsOnly ){
+void LastalArguments::fromArgs( int argc, char** argv, bool optionsOnly,
+				bool isExtraDatabase ){
   programName = argv[0];
   std::string usage = "Usage: " + std::string(programName) +
     " [options] lastdb-name fasta-sequence-file(s)";
@@ -140,6 +168,14 @@ Miscellaneous options (default settings):\n\
 -n: maximum gapless alignments per query position (infinity if m=0, else m)\n\
 -C: omit gapless alignments in >= C others with > score-per-length (off)\n\
 -K: omit alignments whose query range lies in >= K others with > score (off)\n\
+--cull-overlap: omit alignments whose query range is overlapped, by >= this\n\
+    fraction of it, by an alignment with higher score (off)\n\
+--best-per-query: only find this many highest-scoring alignments per query\n\
+    (off)\n\
+--chain=D: chain co-linear gapless alignments <= D apart, and skip gapped\n\
+    extensions from ones covered by their chain's gapped alignment (off)\n\
+--sort-hits=N: do the gapless extensions for blocks of N query positions in\n\
+    reference order (off)\n\
 -i: query batch size (8 KiB, unless there is > 1 thread or lastdb volume)\n\
 -P: number of parallel threads ("
     + stringify(numOfThreads) + ")\n\
@@ -159,6 +195,15 @@ Miscellaneous options (default settings):\n\
 -Q: input format: 0=fasta, 1=fastq-sanger, 2=fastq-solexa, 3=fastq-illumina,\n\
                   4=prb, 5=PSSM ("
     + stringify(inputFormat) + ")\n\
+--database='LASTDB OUTFILE [OPTIONS]': also align the queries to another\n\
+    database, in the same pass, writing the alignments to OUTFILE\n\
+--filter='CONDITIONS': only write alignments that meet all these conditions,\n\
+    e.g. 'identity>80 scov>0.7', using: identity, scov, qcov, evalue,\n\
+    bitscore, score (off)\n\
+--watch=DIR: after the query files, keep aligning new query files in DIR,\n\
+    or if DIR is -, keep aligning stdin, writing results without delay\n\
+--stats=FILE: write counts and times for each batch, and the whole run, as\n\
+    JSON lines to FILE, and a progress snapshot whenever sent SIGUSR1\n\
 \n\
 Report bugs to: last-align (ATmark) googlegroups (dot) com\n\
 LAST home page: http://last.cbrc.jp/\n\
@@ -293,10 +338,12 @@ LAST home page: http://last.cbrc.jp/\n\
       unstringify( cullingLimitForFinalAlignments, optarg );
       break;
     case 'i':
+      checkNotExtraDatabase( "-i", isExtraDatabase );
       unstringifySize( batchSize, optarg );
       if( batchSize <= 0 ) badopt( c, optarg );  // 0 means "not specified"
       break;
     case 'P':
+      checkNotExtraDatabase( "-P", isExtraDatabase );
       unstringify( numOfThreads, optarg );
       break;
     case 'R':
@@ -331,6 +378,51 @@ LAST home page: http://last.cbrc.jp/\n\
     case 'Q':
       unstringify( inputFormat, optarg );
       break;
+    case optDatabase:
+      checkNotExtraDatabase( "--database", isExtraDatabase );
+      {
+	std::istringstream iss( optarg );
+	std::string name, outFileName;
+	if( !(iss >> name >> outFileName) )
+	  ERR( std::string("bad option value: --database ") + optarg );
+      }
+      extraDatabases.push_back( optarg );
+      break;
+    case optWatch:
+      checkNotExtraDatabase( "--watch", isExtraDatabase );
+      watchDirectory = optarg;
+      break;
+    case optStats:
+      checkNotExtraDatabase( "--stats", isExtraDatabase );
+      statsFile = optarg;
+      break;
+    case optFilter:
+      alignmentFilter = optarg;
+      break;
+    case optBestPerQuery:
+      unstringify( maxAlignmentsPerQuery, optarg );
+      if( maxAlignmentsPerQuery <= 0 )
+	ERR( std::string("bad option value: --best-per-query ") + optarg );
+      break;
+    case optCullOverlap:
+      unstringify( cullingOverlapFraction, optarg );
+      if( cullingOverlapFraction <= 0 || cullingOverlapFraction > 1 )
+	ERR( std::string("bad option value: --cull-overlap ") + optarg );
+      break;
+    case optChain:
+      {
+	long d;  // signed, so that negative values are caught
+	unstringify( d, optarg );
+	if( d < 1 || d > long(indexT(-1)) )
+	  ERR( std::string("bad option value: --chain ") + optarg );
+	maxChainDistance = d;
+      }
+      break;
+    case optSortHits:
+      unstringify( sortedHitBlock, optarg );
+      if( sortedHitBlock <= 0 )
+	ERR( std::string("bad option value: --sort-hits ") + optarg );
+      break;
 
     case '?':
       ERR( "bad option" );
@@ -355,6 +447,9 @@ LAST home page: http://last.cbrc.jp/\n\
   if( isTranslated() && isQueryStrandMatrix )
     ERR( "can't combine option -F with option -S 1" );
 
+  if( isTranslated() && maxChainDistance )
+    ERR( "can't combine option -F with option --chain" );
+
   if( globality == 1 && outputType == 1 )
     ERR( "can't combine option -T 1 with option -j 1" );
 
@@ -374,7 +469,8 @@ LAST home page: http://last.cbrc.jp/\n\
   inputStart = optind;
 }
 
-void LastalArguments::fromLine( const std::string& line ){
+void LastalArguments::fromLine( const std::string& line,
+				bool isExtraDatabase ){
   const char* delimiters = " \t";
   const char* s = line.c_str();
   std::vector<char> args( s, s + line.size() + 1 );
@@ -385,7 +481,7 @@ void LastalArguments::fromLine( const std::string& line ){
     i = std::strtok( 0, delimiters );
     argv.push_back(i);
   }
-  fromArgs( argv.size() - 1, &argv[0], true );
+  fromArgs( argv.size() - 1, &argv[0], true, isExtraDatabase );
 }
 
 void LastalArguments::fromString( const std::string& s ){
@@ -598,10 +694,18 @@ void LastalArguments::writeCommented( std::ostream& stream ) const{
     stream << " C=" << cullingLimitForGaplessAlignments;
   if( cullingLimitForFinalAlignments )
     stream << " K=" << cullingLimitForFinalAlignments;
+  if( cullingOverlapFraction > 0 )
+    stream << " cull-overlap=" << cullingOverlapFraction;
+  if( maxAlignmentsPerQuery )
+    stream << " best-per-query=" << maxAlignmentsPerQuery;
   stream << " k=" << queryStep;
   if( minimizerWindow > 1 )
     stream << " W=" << minimizerWindow;
   stream << " w=" << maxRepeatDistance;
+  if( maxChainDistance )
+    stream << " chain=" << maxChainDistance;
+  if( sortedHitBlock )
+    stream << " sort-hits=" << sortedHitBlock;
   stream << " t=" << temperature;
   if( outputType > 4 && outputType < 7 )
     stream << " g=" << gamma;
@@ -609,6 +713,9 @@ void LastalArguments::writeCommented( std::ostream& stream ) const{
   stream << " Q=" << inputFormat;
   stream << '\n';
 
+  if( !alignmentFilter.empty() )
+    stream << "# filter: " << alignmentFilter << '\n';
+
   stream << "# " << lastdbName << '\n';
 }
 
@@ -8,6 +8,7 @@
 #include "SequenceFormat.hh"
 
 #include <string>
+#include <vector>
 #include <iosfwd>
 #include <stddef.h>  // size_t
 
@@ -19,16 +20,19 @@ struct LastalArguments{
   // set the parameters to their default values:
   LastalArguments();
 
-  // set parameters from a list of arguments:
-  void fromArgs( int argc, char** argv, bool optionsOnly = false );
+  // set parameters from a list of arguments.  If isExtraDatabase, they
+  // are the OPTIONS of --database, which can't include -P, -i,
+  // --database, --watch, or --stats.
+  void fromArgs( int argc, char** argv, bool optionsOnly = false,
+		 bool isExtraDatabase = false );
 
   // set parameters from a command line (by splitting it into arguments):
-  void fromLine( const std::string& line );
+  void fromLine( const std::string& line, bool isExtraDatabase = false );
 
   // set parameters from lines beginning with "#last":
   void fromString( const std::string& s );
 
-  void resetCumulativeOptions() { verbosity = 0; }
+  void resetCumulativeOptions() { verbosity = 0; extraDatabases.clear(); }
 
   // get the name of the substitution score matrix:
   const char* matrixName( bool isProtein ) const;
@@ -91,15 +95,23 @@ struct LastalArguments{
   indexT maxGaplessAlignmentsPerQueryPosition;
   size_t cullingLimitForGaplessAlignments;
   size_t cullingLimitForFinalAlignments;
+  double cullingOverlapFraction;
+  size_t maxAlignmentsPerQuery;
   indexT queryStep;
   indexT minimizerWindow;
   indexT batchSize;  // approx size of query sequences to scan in 1 batch
   unsigned numOfThreads;
   indexT maxRepeatDistance;  // suppress repeats <= this distance apart
+  indexT maxChainDistance;  // chain gapless alignments <= this distance apart
+  indexT sortedHitBlock;  // query positions per block of sorted matches
   double temperature;  // probability = exp( score / temperature ) / Z
   double gamma;        // parameter for gamma-centroid alignment
   std::string geneticCodeFile;
+  std::string alignmentFilter;  // conditions for keeping alignments
+  std::string watchDirectory;  // "-" means stream stdin
+  std::string statsFile;  // write JSON statistics here
   int verbosity;
+  std::vector<std::string> extraDatabases;  // "LASTDB OUTFILE [OPTIONS]"
 
   // positional arguments:
   const char* programName;
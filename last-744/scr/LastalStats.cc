@@ -0,0 +1,148 @@
+// Copyright 2026 The ARGpore authors
+
+#include "LastalStats.hh"
+
+#include <time.h>  // clock_gettime
+#include <sstream>
+#include <stdexcept>
+
+#define ERR(x) throw std::runtime_error(x)
+
+namespace cbrc {
+
+static const char *const countNames[] = {
+  "seedMatches", "gaplessExtensions", "gaplessAlignments",
+  "gappedExtensions", "gappedAlignments", "dpCells",
+  "culledAlignments", "outputAlignments"
+};
+
+static const char *const phaseNames[] = {
+  "gapless", "gapped", "final", "formatting", "ioWait", "other"
+};
+
+static ThreadStats::countT nanoseconds(clockid_t clockId) {
+  struct timespec t;
+  clock_gettime(clockId, &t);
+  return t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+static double seconds(clockid_t clockId) {
+  return nanoseconds(clockId) / 1e9;
+}
+
+ThreadStats::ThreadStats() : isTiming(false), phase(other),
+			     phaseWallBeg(0), phaseCpuBeg(0) {
+  for (int i = 0; i < numOfCounts; ++i) set(counts[i], 0);
+  for (int i = 0; i < numOfPhases; ++i) set(wallTimes[i], 0);
+  for (int i = 0; i < numOfPhases; ++i) set(cpuTimes[i], 0);
+}
+
+ThreadStats &ThreadStats::operator=(const ThreadStats &s) {
+  for (int i = 0; i < numOfCounts; ++i) set(counts[i], get(s.counts[i]));
+  for (int i = 0; i < numOfPhases; ++i) set(wallTimes[i], get(s.wallTimes[i]));
+  for (int i = 0; i < numOfPhases; ++i) set(cpuTimes[i], get(s.cpuTimes[i]));
+  isTiming = s.isTiming;
+  phase = s.phase;
+  phaseWallBeg = s.phaseWallBeg;
+  phaseCpuBeg = s.phaseCpuBeg;
+  return *this;
+}
+
+void ThreadStats::startTiming() {
+  isTiming = true;
+  phase = other;
+  phaseWallBeg = 0;  // the clocks are read at the first phase change
+}
+
+ThreadStats::Phase ThreadStats::changePhase(Phase newPhase) {
+  Phase oldPhase = phase;
+  if (!isTiming || newPhase == oldPhase) return oldPhase;
+  countT wall = nanoseconds(CLOCK_MONOTONIC);
+  countT cpu = nanoseconds(CLOCK_THREAD_CPUTIME_ID);
+  if (phaseWallBeg) {
+    set(wallTimes[oldPhase], get(wallTimes[oldPhase]) + (wall - phaseWallBeg));
+    set(cpuTimes[oldPhase], get(cpuTimes[oldPhase]) + (cpu - phaseCpuBeg));
+  }
+  phase = newPhase;
+  phaseWallBeg = wall;
+  phaseCpuBeg = cpu;
+  return oldPhase;
+}
+
+void StatsTotals::clear() {
+  for (int i = 0; i < ThreadStats::numOfCounts; ++i) counts[i] = 0;
+  for (int i = 0; i < ThreadStats::numOfPhases; ++i) wallTimes[i] = 0;
+  for (int i = 0; i < ThreadStats::numOfPhases; ++i) cpuTimes[i] = 0;
+}
+
+void StatsTotals::add(const ThreadStats &s) {
+  for (int i = 0; i < ThreadStats::numOfCounts; ++i)
+    counts[i] += s.count(ThreadStats::Count(i));
+  for (int i = 0; i < ThreadStats::numOfPhases; ++i) {
+    wallTimes[i] += s.wallTime(ThreadStats::Phase(i));
+    cpuTimes[i] += s.cpuTime(ThreadStats::Phase(i));
+  }
+}
+
+void StatsFile::open(const std::string &fileName) {
+  file.open(fileName.c_str());
+  if (!file) ERR("can't open file: " + fileName);
+  runWallBeg = batchWallBeg = seconds(CLOCK_MONOTONIC);
+  runCpuBeg = batchCpuBeg = seconds(CLOCK_PROCESS_CPUTIME_ID);
+}
+
+void StatsFile::writeBatch(ThreadStats::countT batchNum,
+			   ThreadStats::countT numOfQueries,
+			   const StatsTotals &now) {
+  double wall = seconds(CLOCK_MONOTONIC);
+  double cpu = seconds(CLOCK_PROCESS_CPUTIME_ID);
+  std::ostringstream fields;
+  fields << "\"batch\":" << batchNum << ",\"queries\":" << numOfQueries;
+  writeLine("batch", fields.str(), wall - batchWallBeg, cpu - batchCpuBeg,
+	    now, previous);
+  batchWallBeg = wall;
+  batchCpuBeg = cpu;
+  previous = now;
+}
+
+void StatsFile::writeProgress(ThreadStats::countT numOfBatches,
+			      const StatsTotals &now) {
+  std::ostringstream fields;
+  fields << "\"batches\":" << numOfBatches;
+  writeLine("progress", fields.str(),
+	    seconds(CLOCK_MONOTONIC) - runWallBeg,
+	    seconds(CLOCK_PROCESS_CPUTIME_ID) - runCpuBeg, now, StatsTotals());
+}
+
+void StatsFile::writeRun(ThreadStats::countT numOfBatches,
+			 ThreadStats::countT numOfQueries,
+			 const StatsTotals &now) {
+  std::ostringstream fields;
+  fields << "\"batches\":" << numOfBatches << ",\"queries\":" << numOfQueries;
+  writeLine("run", fields.str(),
+	    seconds(CLOCK_MONOTONIC) - runWallBeg,
+	    seconds(CLOCK_PROCESS_CPUTIME_ID) - runCpuBeg, now, StatsTotals());
+  if (!file.flush()) ERR("can't write the stats file");
+}
+
+// The times of the phases are summed over threads, so they can add
+// up to more than the wall-clock time
+void StatsFile::writeLine(const char *type, const std::string &fields,
+			  double wallSeconds, double cpuSeconds,
+			  const StatsTotals &now, const StatsTotals &old) {
+  std::ostringstream s;
+  s << "{\"type\":\"" << type << "\"," << fields
+    << ",\"wallSeconds\":" << wallSeconds
+    << ",\"cpuSeconds\":" << cpuSeconds;
+  for (int i = 0; i < ThreadStats::numOfCounts; ++i)
+    s << ",\"" << countNames[i] << "\":" << now.counts[i] - old.counts[i];
+  s << ",\"phases\":{";
+  for (int i = 0; i < ThreadStats::numOfPhases; ++i)
+    s << (i ? "," : "") << '"' << phaseNames[i] << "\":{\"wallSeconds\":"
+      << (now.wallTimes[i] - old.wallTimes[i]) / 1e9 << ",\"cpuSeconds\":"
+      << (now.cpuTimes[i] - old.cpuTimes[i]) / 1e9 << '}';
+  s << "}}\n";
+  file << s.str() << std::flush;  // so that progress can be followed
+}
+
+}
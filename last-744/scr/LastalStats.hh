@@ -0,0 +1,132 @@
+// Copyright 2026 The ARGpore authors
+
+// Counts and times for each step of lastal, written as JSON lines,
+// to help choose options and plan capacity.  Each thread adds to its
+// own ThreadStats, so there's no contention.  The numbers are
+// atomics written only by their own thread, so another thread can
+// read a progress snapshot at any time.
+
+#ifndef LASTAL_STATS_HH
+#define LASTAL_STATS_HH
+
+#include <atomic>
+#include <fstream>
+#include <string>
+
+namespace cbrc {
+
+class ThreadStats {
+public:
+  typedef unsigned long long countT;
+
+  enum Count { seedMatches, gaplessExtensions, gaplessAlignments,
+	       gappedExtensions, gappedAlignments, dpCells,
+	       culledAlignments, outputAlignments, numOfCounts };
+
+  // The time of each thread is split between these phases.  "other"
+  // is everything else, including waiting for work.
+  enum Phase { gapless, gapped, final, formatting, ioWait, other,
+	       numOfPhases };
+
+  ThreadStats();
+  ThreadStats(const ThreadStats &s) { *this = s; }
+  ThreadStats &operator=(const ThreadStats &s);
+
+  // Measure times: this costs a few system calls per phase change.
+  // The thread CPU time is read by whichever thread calls
+  // changePhase, so it must always be the same thread.
+  void startTiming();
+
+  void add(Count c, countT n) { set(counts[c], get(counts[c]) + n); }
+
+  void setCount(Count c, countT n) { set(counts[c], n); }
+
+  countT count(Count c) const { return get(counts[c]); }
+
+  // Wall-clock and CPU nanoseconds
+  countT wallTime(Phase p) const { return get(wallTimes[p]); }
+  countT cpuTime(Phase p) const { return get(cpuTimes[p]); }
+
+  // Charge the time since the last phase change to the old phase,
+  // and return it
+  Phase changePhase(Phase newPhase);
+
+private:
+  typedef std::atomic<countT> Number;
+
+  Number counts[numOfCounts];
+  Number wallTimes[numOfPhases];
+  Number cpuTimes[numOfPhases];
+  bool isTiming;
+  Phase phase;
+  countT phaseWallBeg;
+  countT phaseCpuBeg;
+
+  // Only the owning thread writes, so a plain load and store is
+  // enough: it's cheaper than an atomic read-modify-write
+  static countT get(const Number &x)
+  { return x.load(std::memory_order_relaxed); }
+
+  static void set(Number &x, countT n)
+  { x.store(n, std::memory_order_relaxed); }
+};
+
+// Charges the time from construction to destruction to a phase
+class PhaseTimer {
+public:
+  PhaseTimer(ThreadStats &s, ThreadStats::Phase p)
+    : stats(s), oldPhase(s.changePhase(p)) {}
+
+  ~PhaseTimer() { stats.changePhase(oldPhase); }
+
+private:
+  ThreadStats &stats;
+  ThreadStats::Phase oldPhase;
+};
+
+// The sum of several ThreadStats
+struct StatsTotals {
+  ThreadStats::countT counts[ThreadStats::numOfCounts];
+  ThreadStats::countT wallTimes[ThreadStats::numOfPhases];
+  ThreadStats::countT cpuTimes[ThreadStats::numOfPhases];
+
+  StatsTotals() { clear(); }
+  void clear();
+  void add(const ThreadStats &s);
+};
+
+class StatsFile {
+public:
+  // Throw runtime_error if it can't be opened
+  void open(const std::string &fileName);
+
+  bool isOpen() const { return file.is_open(); }
+
+  // Write the stats since the previous batch
+  void writeBatch(ThreadStats::countT batchNum,
+		  ThreadStats::countT numOfQueries, const StatsTotals &now);
+
+  // Write the stats so far, in a run that's still going
+  void writeProgress(ThreadStats::countT numOfBatches,
+		     const StatsTotals &now);
+
+  // Write the stats for the whole run
+  void writeRun(ThreadStats::countT numOfBatches,
+		ThreadStats::countT numOfQueries, const StatsTotals &now);
+
+private:
+  std::ofstream file;
+  double runWallBeg;
+  double runCpuBeg;
+  double batchWallBeg;
+  double batchCpuBeg;
+  StatsTotals previous;
+
+  void writeLine(const char *type, const std::string &fields,
+		 double wallSeconds, double cpuSeconds,
+		 const StatsTotals &now, const StatsTotals &old);
+};
+
+}
+
+#endif
@@ -39,6 +39,7 @@ LastdbArguments::LastdbArguments() :
   userAlphabet(""),
   minSeedLimit(0),
   bucketDepth(indexT(-1)),  // means: use the default (adapts to the data)
+  bucketBytes(-1),  // means: no memory budget for the buckets
   childTableType(0),
   isCountsOnly(false),
   verbosity(0),
@@ -76,6 +77,7 @@ Advanced Options (default settings):\n\
 -i: minimum limit on initial matches per query position ("
     + stringify(minSeedLimit) + ")\n\
 -b: bucket depth\n\
+-B: maximum bucket size in bytes, if -b isn't given\n\
 -C: child table type: 0=none, 1=byte-size, 2=short-size, 3=full ("
     + stringify(childTableType) + ")\n\
 -x: just count sequences and letters\n\
@@ -88,7 +90,7 @@ LAST home page: http://last.cbrc.jp/\n\
 
   optind = 1;  // allows us to scan arguments more than once(???)
   int c;
-  while( (c = myGetopt(argc, argv, "hVpR:cm:s:w:W:P:u:a:i:b:C:xvQ:")) != -1 ) {
+  while( (c = myGetopt(argc, argv, "hVpR:cm:s:w:W:P:u:a:i:b:B:C:xvQ:")) != -1 ) {
     switch(c){
     case 'h':
       std::cout << help;
@@ -140,6 +142,9 @@ LAST home page: http://last.cbrc.jp/\n\
     case 'b':
       unstringify( bucketDepth, optarg );
       break;
+    case 'B':
+      unstringifySize( bucketBytes, optarg );
+      break;
     case 'C':
       unstringify( childTableType, optarg );
       if( childTableType < 0 || childTableType > 3 ) badopt( c, optarg );
@@ -44,6 +44,7 @@ struct LastdbArguments{
   std::string userAlphabet;
   indexT minSeedLimit;
   indexT bucketDepth;
+  size_t bucketBytes;
   int childTableType;
   bool isCountsOnly;
   int verbosity;
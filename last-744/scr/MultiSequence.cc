@@ -3,7 +3,7 @@
 #include "MultiSequence.hh"
 #include "io.hh"
 #include <sstream>
-#include <algorithm>  // upper_bound
+#include <algorithm>  // min, swap, upper_bound
 #include <cassert>
 #include <cctype>  // isspace
 #include <iterator>  // istreambuf_iterator
@@ -28,6 +28,44 @@ void MultiSequence::reinitForAppending(){
   if( !names.v.empty() ) nameEnds.v.push_back( names.v.size() );
 }
 
+void MultiSequence::reinitForAppending( const MultiSequence& m ){
+  padSize = m.padSize;
+  seq.v.assign( m.seq.v.begin() + m.ends.v.back() - padSize, m.seq.v.end() );
+  ends.v.assign( 1, padSize );
+  names.v.assign( m.names.v.begin() + m.nameEnds.v[ m.finishedSequences() ],
+		  m.names.v.end() );
+  nameEnds.v.assign( 1, 0 );
+  if( !names.v.empty() ) nameEnds.v.push_back( names.v.size() );
+
+  // the appendFrom* functions expect these to end with data for seq:
+  qualityScoresPerLetter = m.qualityScoresPerLetter;
+  size_t qualSize = std::min( m.qualityScores.v.size(),
+			      seq.v.size() * qualityScoresPerLetter );
+  qualityScores.v.assign( m.qualityScores.v.end() - qualSize,
+			  m.qualityScores.v.end() );
+  size_t pssmSize = std::min( m.pssm.size(),
+			      seq.v.size() * scoreMatrixRowSize );
+  pssm.assign( m.pssm.end() - pssmSize, m.pssm.end() );
+  pssmColumnLetters = m.pssmColumnLetters;
+}
+
+void MultiSequence::swap( MultiSequence& m ){
+  std::swap( padSize, m.padSize );
+  seq.v.swap( m.seq.v );
+  seq.m.swap( m.seq.m );
+  ends.v.swap( m.ends.v );
+  ends.m.swap( m.ends.m );
+  names.v.swap( m.names.v );
+  names.m.swap( m.names.m );
+  nameEnds.v.swap( m.nameEnds.v );
+  nameEnds.m.swap( m.nameEnds.m );
+  pssm.swap( m.pssm );
+  pssmColumnLetters.swap( m.pssmColumnLetters );
+  qualityScores.v.swap( m.qualityScores.v );
+  qualityScores.m.swap( m.qualityScores.m );
+  std::swap( qualityScoresPerLetter, m.qualityScoresPerLetter );
+}
+
 void MultiSequence::fromFiles( const std::string& baseName, indexT seqCount,
                                size_t qualitiesPerLetter ){
   ends.m.open( baseName + ".ssp", seqCount + 1 );
@@ -28,6 +28,12 @@ class MultiSequence{
   // re-initialize, but keep the last sequence if it is unfinished
   void reinitForAppending();
 
+  // re-initialize, with the last sequence of m if it is unfinished
+  void reinitForAppending( const MultiSequence& m );
+
+  // exchange contents with m
+  void swap( MultiSequence& m );
+
   // read seqCount finished sequences, and their names, from binary files
   void fromFiles( const std::string& baseName, indexT seqCount,
                   size_t qualitiesPerLetter );
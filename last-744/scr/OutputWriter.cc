@@ -0,0 +1,190 @@
+// Copyright 2026 The ARGpore authors
+
+#include "OutputWriter.hh"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>  // IOV_MAX
+#include <string.h>
+#include <sys/uio.h>  // writev
+#include <unistd.h>
+#include <algorithm>  // min
+#include <stdexcept>
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+#define ERR(x) throw std::runtime_error(x)
+
+namespace cbrc {
+
+enum { minWriteBytes = 1 << 16 };  // without threads, write this much at once
+
+enum { minSharedBytes = 1 << 10 };  // putShared copies texts smaller than this
+
+OutputWriter::OutputWriter() : fd(1), isOwnFile(false), queuedBytes(0),
+			       givenBytes(0), writtenBytes(0), isError(false) {
+#ifdef HAS_CXX_THREADS
+  isStopping = false;
+  isWriting = false;
+#endif
+}
+
+OutputWriter::~OutputWriter() {
+  stop();
+  writeQueue();  // in case there's no writer thread
+  if (isOwnFile) close(fd);
+}
+
+void OutputWriter::open(const std::string &fileName) {
+  if (fileName == "-") return;
+  fd = ::open(fileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if (fd < 0) ERR("can't open file: " + fileName);
+  isOwnFile = true;
+}
+
+void OutputWriter::put(const char *text, size_t size) {
+  add(text, size, true);
+}
+
+void OutputWriter::put(const char *text) {
+  put(text, strlen(text));
+}
+
+void OutputWriter::putShared(const char *text) {
+  size_t size = strlen(text);
+  add(text, size, size < minSharedBytes);
+}
+
+void OutputWriter::add(const char *text, size_t size, bool isCopy) {
+#ifdef HAS_CXX_THREADS
+  std::unique_lock<std::mutex> lock(mutex);
+  if (!writer.joinable()) writer = std::thread(&OutputWriter::loop, this);
+  while (queuedBytes > 0 && queuedBytes + size > maxQueuedBytes)
+    isChanged.wait(lock);
+#endif
+  std::vector<Piece> &pieces = queue.pieces;
+  if (isCopy) {
+    if (pieces.empty() || pieces.back().text) {
+      Piece p = { 0, 0 };
+      pieces.push_back(p);
+    }
+    pieces.back().size += size;
+    queue.buffer.insert(queue.buffer.end(), text, text + size);
+  } else {
+    Piece p = { text, size };
+    pieces.push_back(p);
+  }
+  queuedBytes += size;
+  givenBytes += size;
+#ifdef HAS_CXX_THREADS
+  isChanged.notify_all();
+#else
+  if (queuedBytes >= minWriteBytes) writeQueue();
+#endif
+}
+
+unsigned long long OutputWriter::position() {
+#ifdef HAS_CXX_THREADS
+  std::lock_guard<std::mutex> lock(mutex);
+#endif
+  return givenBytes;
+}
+
+void OutputWriter::waitUntilWritten(unsigned long long pos) {
+#ifdef HAS_CXX_THREADS
+  std::unique_lock<std::mutex> lock(mutex);
+  while (writtenBytes < pos) isChanged.wait(lock);
+#else
+  if (writtenBytes < pos) writeQueue();
+#endif
+}
+
+void OutputWriter::flush() {
+#ifdef HAS_CXX_THREADS
+  std::unique_lock<std::mutex> lock(mutex);
+  while (!queue.pieces.empty() || isWriting) isChanged.wait(lock);
+#else
+  writeQueue();
+#endif
+  if (isError) ERR("write error");
+}
+
+void OutputWriter::stop() {
+#ifdef HAS_CXX_THREADS
+  if (!writer.joinable()) return;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    isStopping = true;
+  }
+  isChanged.notify_all();
+  writer.join();
+  isStopping = false;
+#endif
+}
+
+#ifdef HAS_CXX_THREADS
+// Write the queued text until told to stop, and the queue is empty.
+// Swapping the queues keeps their capacity, so after warming up
+// there is no more allocation.
+void OutputWriter::loop() {
+  std::unique_lock<std::mutex> lock(mutex);
+  while (true) {
+    while (queue.pieces.empty() && !isStopping) isChanged.wait(lock);
+    if (queue.pieces.empty()) return;
+    std::swap(beingWritten, queue);
+    queue.clear();
+    size_t bytes = queuedBytes;
+    queuedBytes = 0;
+    bool isOk = !isError;
+    isWriting = true;
+    isChanged.notify_all();
+    lock.unlock();
+    if (isOk) isOk = writePieces(beingWritten);
+    lock.lock();
+    if (!isOk) isError = true;
+    writtenBytes += bytes;
+    isWriting = false;
+    isChanged.notify_all();
+  }
+}
+#endif
+
+void OutputWriter::writeQueue() {
+  if (queue.pieces.empty()) return;
+  if (!isError && !writePieces(queue)) isError = true;
+  writtenBytes += queuedBytes;
+  queuedBytes = 0;
+  queue.clear();
+}
+
+bool OutputWriter::writePieces(const Queue &q) {
+  std::vector<iovec> v(q.pieces.size());
+  const char *copied = q.buffer.empty() ? 0 : &q.buffer[0];
+  for (size_t i = 0; i < v.size(); ++i) {
+    const Piece &p = q.pieces[i];
+    const char *text = p.text ? p.text : copied;
+    if (!p.text) copied += p.size;
+    v[i].iov_base = const_cast<char *>(text);
+    v[i].iov_len = p.size;
+  }
+  iovec *b = &v[0];
+  iovec *e = b + v.size();
+  while (b < e) {
+    ssize_t r = writev(fd, b, std::min<size_t>(e - b, IOV_MAX));
+    if (r < 0) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+    size_t done = r;
+    while (b < e && done >= b->iov_len) done -= (b++)->iov_len;
+    if (b < e) {
+      b->iov_base = static_cast<char *>(b->iov_base) + done;
+      b->iov_len -= done;
+    }
+  }
+  return true;
+}
+
+}
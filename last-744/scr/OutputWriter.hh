@@ -0,0 +1,101 @@
+// Copyright 2026 The ARGpore authors
+
+// Writes text to a file in a separate thread, in the order it was
+// given, gathering many pieces into each writev call.  put() copies
+// the text to the end of a buffer.  putShared() doesn't copy big
+// texts: the writer reads them where they are, so the caller must
+// keep them until they are written.  The text waiting to be written
+// is limited to maxQueuedBytes: put() waits for the writer to catch
+// up, if necessary.
+
+#ifndef OUTPUT_WRITER_HH
+#define OUTPUT_WRITER_HH
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+#ifdef HAS_CXX_THREADS
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#endif
+
+namespace cbrc {
+
+class OutputWriter {
+public:
+  enum { maxQueuedBytes = 1 << 24 };
+
+  // Write to stdout, unless open() is called
+  OutputWriter();
+
+  // Write anything still queued, and close the file
+  ~OutputWriter();
+
+  // Write to this file, or stdout if the name is "-".  Throw
+  // runtime_error if it can't be opened.
+  void open(const std::string &fileName);
+
+  // Queue a copy of the text: the caller may re-use its memory
+  void put(const char *text, size_t size);
+
+  void put(const char *text);
+
+  void put(const std::string &text) { put(text.c_str(), text.size()); }
+
+  // Queue a NUL-terminated string without copying it, unless it's
+  // small.  The caller must keep it unchanged until
+  // waitUntilWritten(position()) returns.
+  void putShared(const char *text);
+
+  // The total size of the text given so far
+  unsigned long long position();
+
+  // Wait until the text up to this position is written
+  void waitUntilWritten(unsigned long long pos);
+
+  // Wait until everything queued is written.  Throw runtime_error if
+  // any write failed.
+  void flush();
+
+private:
+  struct Piece {
+    const char *text;  // null means: the next "size" bytes of the buffer
+    size_t size;
+  };
+
+  struct Queue {
+    std::vector<Piece> pieces;
+    std::vector<char> buffer;  // copied text
+    void clear() { pieces.clear(); buffer.clear(); }
+  };
+
+  int fd;
+  bool isOwnFile;
+  Queue queue;  // not yet written
+  Queue beingWritten;
+  size_t queuedBytes;
+  unsigned long long givenBytes;
+  unsigned long long writtenBytes;
+  bool isError;
+
+#ifdef HAS_CXX_THREADS
+  std::thread writer;
+  std::mutex mutex;
+  std::condition_variable isChanged;
+  bool isStopping;
+  bool isWriting;
+
+  void loop();
+#endif
+
+  void add(const char *text, size_t size, bool isCopy);
+  void stop();
+  void writeQueue();
+  bool writePieces(const Queue &q);
+};
+
+}
+
+#endif
@@ -0,0 +1,48 @@
+// Copyright 2026 The ARGpore authors
+
+// Memory for many strings, allocated from big chunks.  The strings
+// can't be freed one by one: clear() frees them all at once, but
+// keeps the chunks for re-use.  This avoids one new[] and delete[]
+// per string.
+
+#ifndef TEXT_ARENA_HH
+#define TEXT_ARENA_HH
+
+#include <stddef.h>
+#include <algorithm>  // max
+#include <vector>
+
+namespace cbrc {
+
+class TextArena {
+public:
+  TextArena() : chunkNum(0), used(0) {}
+
+  char *alloc(size_t size) {
+    if (chunkNum == chunks.size() || used + size > chunks[chunkNum].size()) {
+      if (chunkNum < chunks.size()) ++chunkNum;
+      if (chunkNum == chunks.size()) chunks.push_back(std::vector<char>());
+      std::vector<char> &c = chunks[chunkNum];
+      if (c.size() < size) c.resize(std::max<size_t>(size, chunkSize));
+      used = 0;
+    }
+    char *p = &chunks[chunkNum][0] + used;
+    used += size;
+    return p;
+  }
+
+  void clear() {
+    chunkNum = 0;
+    used = 0;
+  }
+
+private:
+  enum { chunkSize = 1 << 20 };
+  std::vector< std::vector<char> > chunks;
+  size_t chunkNum;  // the chunk we're allocating from
+  size_t used;  // bytes allocated from it
+};
+
+}
+
+#endif
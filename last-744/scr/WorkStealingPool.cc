@@ -0,0 +1,162 @@
+// Copyright 2026 The ARGpore authors
+
+#include "WorkStealingPool.hh"
+
+namespace cbrc {
+
+void WorkStealingPool::resize(size_t numOfThreads) {
+  stop();
+#ifndef HAS_CXX_THREADS
+  numOfThreads = 1;
+#endif
+  if (numOfThreads < 1) numOfThreads = 1;
+  std::vector<Range>(numOfThreads).swap(ranges);
+#ifdef HAS_CXX_THREADS
+  generation = 0;
+  numOfBusyThreads = 0;
+  isStopping = false;
+  isFailed = false;
+  for (size_t i = 1; i < numOfThreads; ++i)
+    threads.push_back(std::thread(&WorkStealingPool::loop, this, i));
+#endif
+}
+
+void WorkStealingPool::stop() {
+#ifdef HAS_CXX_THREADS
+  if (threads.empty()) return;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    isStopping = true;
+  }
+  isStarted.notify_all();
+  for (size_t i = 0; i < threads.size(); ++i) threads[i].join();
+  threads.clear();
+#endif
+}
+
+void WorkStealingPool::run(const std::vector<size_t> &firstTasks,
+			   const Task &t) {
+  if (ranges.empty()) resize(1);
+  for (size_t i = 0; i < ranges.size(); ++i) {
+    ranges[i].beg = firstTasks[i];
+    ranges[i].end = firstTasks[i + 1];
+  }
+  task = &t;
+#ifdef HAS_CXX_THREADS
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    numOfBusyThreads = threads.size();
+    ++generation;
+  }
+  isStarted.notify_all();
+#endif
+  work(0);
+#ifdef HAS_CXX_THREADS
+  std::exception_ptr e;
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (numOfBusyThreads) isFinished.wait(lock);
+    e = error;
+    error = std::exception_ptr();
+    isFailed = false;
+  }
+  task = 0;
+  if (e) std::rethrow_exception(e);
+#else
+  task = 0;
+#endif
+}
+
+void WorkStealingPool::work(size_t threadNum) {
+  size_t taskNum;
+#ifdef HAS_CXX_THREADS
+  while (take(threadNum, taskNum)) {
+    try {
+      (*task)(threadNum, taskNum);
+    } catch (...) {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (!isFailed) error = std::current_exception();
+      isFailed = true;
+    }
+  }
+#else
+  while (take(threadNum, taskNum)) (*task)(threadNum, taskNum);
+#endif
+}
+
+#ifdef HAS_CXX_THREADS
+void WorkStealingPool::loop(size_t threadNum) {
+  unsigned long oldGeneration = 0;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      while (generation == oldGeneration && !isStopping) isStarted.wait(lock);
+      if (isStopping) return;
+      oldGeneration = generation;
+    }
+    work(threadNum);
+    std::lock_guard<std::mutex> lock(mutex);
+    if (--numOfBusyThreads == 0) isFinished.notify_all();
+  }
+}
+
+bool WorkStealingPool::take(size_t threadNum, size_t &taskNum) {
+  if (isFailed) return false;
+  Range &r = ranges[threadNum];
+  {
+    std::lock_guard<std::mutex> lock(r.mutex);
+    if (r.beg < r.end) {
+      taskNum = r.beg++;
+      return true;
+    }
+  }
+  return steal(threadNum, taskNum);
+}
+
+// Take the back half of the biggest other range.  Only one range is
+// locked at a time, so the biggest may have shrunk by the time we
+// take from it: then look again.
+bool WorkStealingPool::steal(size_t threadNum, size_t &taskNum) {
+  while (true) {
+    size_t victim = threadNum;
+    size_t maxSize = 0;
+    for (size_t i = 0; i < ranges.size(); ++i) {
+      if (i == threadNum) continue;
+      std::lock_guard<std::mutex> lock(ranges[i].mutex);
+      size_t s = ranges[i].end - ranges[i].beg;
+      if (s > maxSize) {
+	maxSize = s;
+	victim = i;
+      }
+    }
+    if (maxSize == 0) return false;
+
+    size_t beg, end;
+    {
+      Range &v = ranges[victim];
+      std::lock_guard<std::mutex> lock(v.mutex);
+      size_t s = v.end - v.beg;
+      if (s == 0) continue;
+      end = v.end;
+      beg = end - (s + 1) / 2;
+      v.end = beg;
+    }
+
+    Range &r = ranges[threadNum];
+    std::lock_guard<std::mutex> lock(r.mutex);
+    r.beg = beg + 1;
+    r.end = end;
+    taskNum = beg;
+    return true;
+  }
+}
+#else
+bool WorkStealingPool::take(size_t threadNum, size_t &taskNum) {
+  Range &r = ranges[threadNum];
+  if (r.beg == r.end) return false;
+  taskNum = r.beg++;
+  return true;
+}
+#endif
+
+}
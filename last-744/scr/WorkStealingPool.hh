@@ -0,0 +1,78 @@
+// Copyright 2026 The ARGpore authors
+
+// A pool of threads that lives as long as the program, and runs
+// batches of numbered tasks.  Each thread starts with a contiguous
+// range of tasks, and when it runs out, it steals half of the
+// remaining tasks of the thread that has the most.  So a few slow
+// tasks don't leave the other threads idle.
+
+#ifndef WORK_STEALING_POOL_HH
+#define WORK_STEALING_POOL_HH
+
+#include <stddef.h>
+#include <functional>
+#include <vector>
+
+#ifdef HAS_CXX_THREADS
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+#endif
+
+namespace cbrc {
+
+class WorkStealingPool {
+public:
+  typedef std::function<void(size_t threadNum, size_t taskNum)> Task;
+
+  WorkStealingPool() : task(0) {}
+  ~WorkStealingPool() { stop(); }
+
+  // Use this many threads, including the caller of run()
+  void resize(size_t numOfThreads);
+
+  size_t size() const { return ranges.size(); }
+
+  // Run tasks numbered [firstTasks[0], firstTasks[size()]), and
+  // return when they're all done.  Thread i initially gets tasks
+  // [firstTasks[i], firstTasks[i+1]).  If any task throws, the
+  // remaining tasks are skipped, and the first exception is rethrown.
+  void run(const std::vector<size_t> &firstTasks, const Task &t);
+
+private:
+  struct Range {
+    size_t beg;
+    size_t end;
+#ifdef HAS_CXX_THREADS
+    std::mutex mutex;
+#endif
+  };
+
+  std::vector<Range> ranges;
+  const Task *task;
+
+#ifdef HAS_CXX_THREADS
+  std::vector<std::thread> threads;
+  std::mutex mutex;
+  std::condition_variable isStarted;
+  std::condition_variable isFinished;
+  unsigned long generation;
+  size_t numOfBusyThreads;
+  bool isStopping;
+  std::atomic<bool> isFailed;  // read without locking, for each task
+  std::exception_ptr error;  // the first exception, guarded by mutex
+
+  void loop(size_t threadNum);
+  bool steal(size_t threadNum, size_t &taskNum);
+#endif
+
+  void stop();
+  bool take(size_t threadNum, size_t &taskNum);
+  void work(size_t threadNum);
+};
+
+}
+
+#endif
@@ -0,0 +1,456 @@
+// Copyright 2026 The ARGpore authors
+
+// Read BlastTab+ alignments of reads to ARG genes and to marker
+// genes, and write tables of ARG hits, read taxa, and ARG hits with
+// taxa.  This does the same job as ARGpore's old Ruby and R scripts,
+// in one pass, holding only one read's alignments at a time.
+
+#include "io.hh"
+#include "stringify.hh"
+#include "zio.hh"
+
+#include <getopt.h>
+#include <algorithm>  // stable_sort, swap
+#include <cstdlib>  // EXIT_SUCCESS, EXIT_FAILURE, strtod
+#include <iostream>
+#include <map>
+#include <new>  // bad_alloc
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#define ERR(x) throw std::runtime_error(x)
+
+using namespace cbrc;
+
+namespace {
+
+struct Options {
+  double minSimilarity;  // percent identity must exceed this
+  double minCoverage;  // aligned fraction of the gene must exceed this
+  std::string argTableName;
+  std::string taxaTableName;
+  std::string outPrefix;
+  std::string readsFileName;
+  std::string argAlignmentsFileName;
+  std::string markerAlignmentsFileName;
+};
+
+// BlastTab+ columns
+enum { qName, sName, similarity, alnLength, mismatches, gapOpens,
+       qStart, qEnd, sStart, sEnd, evalue, bitScore, qLength, sLength,
+       blastTabPlusColumns };
+
+typedef std::vector<std::string> Row;
+
+struct Hit {
+  Row fields;
+  long start;  // query start, at most end
+  long end;
+  double bitScore;
+  double length;
+};
+
+struct TypeCount {
+  std::string type;
+  size_t count;
+};
+
+typedef std::unordered_map<std::string, Row> Table;
+
+void splitTabs(const std::string &line, Row &fields) {
+  fields.clear();
+  size_t i = 0;
+  while (true) {
+    size_t j = line.find('\t', i);
+    if (j == std::string::npos) break;
+    fields.push_back(line.substr(i, j - i));
+    i = j + 1;
+  }
+  fields.push_back(line.substr(i));
+}
+
+double toNumber(const std::string &s) {
+  const char *b = s.c_str();
+  char *e;
+  double x = std::strtod(b, &e);
+  if (e == b || *e) ERR("bad number: " + s);
+  return x;
+}
+
+// Read a table with a header line.  The first column is the key, and
+// the other columns are stored.
+void readTable(const std::string &fileName, size_t numOfColumns,
+	       Row &header, Table &table) {
+  std::ifstream file;
+  std::istream &in = openIn(fileName, file);
+  std::string line;
+  Row fields;
+  if (!getline(in, line)) ERR("empty table: " + fileName);
+  splitTabs(line, header);
+  if (header.size() < numOfColumns) ERR("too few columns in: " + fileName);
+  while (getline(in, line)) {
+    if (line.empty()) continue;
+    splitTabs(line, fields);
+    if (fields.size() != header.size())
+      ERR("wrong number of columns in " + fileName + ": " + line);
+    table[fields[0]].assign(fields.begin() + 1, fields.end());
+  }
+  if (in.bad()) ERR("can't read file: " + fileName);
+}
+
+// Get the next sequence name in a FASTA or FASTQ file
+bool readSequenceName(std::istream &in, std::string &name) {
+  std::string line;
+  while (getline(in, line)) {
+    if (line.empty()) continue;
+    char c = line[0];
+    if (c == '>' || c == '@') {
+      size_t e = line.find_first_of(" \t\r", 1);
+      name = line.substr(1, e == std::string::npos ? e : e - 1);
+      if (c == '@') {  // skip the sequence, "+" line, and qualities
+	for (int i = 0; i < 3; ++i) getline(in, line);
+      }
+      return true;
+    }
+  }
+  return false;
+}
+
+// The reads are named like READ-SUFFIX: ARGpore treats names with
+// the same READ as one read
+std::string readName(const std::string &sequenceName) {
+  return sequenceName.substr(0, sequenceName.find('-'));
+}
+
+class AlignmentReader {
+public:
+  AlignmentReader(const std::string &fileName)
+    : fileName(fileName), in(openIn(fileName, file)) { next(); }
+
+  bool isMore() const { return isLine; }
+
+  const std::string &queryName() const { return fields[qName]; }
+
+  // Append the alignments of this query, if they come next, to hits
+  void getHits(const std::string &name, const Options &opts,
+	       std::vector<Hit> &hits) {
+    while (isLine && fields[qName] == name) {
+      Hit h;
+      h.length = toNumber(fields[alnLength]);
+      double s = toNumber(fields[similarity]);
+      if (s > opts.minSimilarity &&
+	  h.length / toNumber(fields[sLength]) > opts.minCoverage) {
+	h.start = toNumber(fields[qStart]);
+	h.end = toNumber(fields[qEnd]);
+	if (h.start > h.end) std::swap(h.start, h.end);
+	h.bitScore = toNumber(fields[bitScore]);
+	h.fields.swap(fields);
+	hits.push_back(h);
+      }
+      next();
+    }
+  }
+
+private:
+  std::string fileName;
+  std::ifstream file;
+  std::istream &in;
+  std::string line;
+  Row fields;
+  bool isLine;
+
+  void next() {
+    while (getline(in, line)) {
+      if (line.empty() || line[0] == '#') continue;
+      splitTabs(line, fields);
+      if (fields.size() != blastTabPlusColumns)
+	ERR("expected BlastTab+ format in " + fileName + ": " + line);
+      isLine = true;
+      return;
+    }
+    if (in.bad()) ERR("can't read file: " + fileName);
+    isLine = false;
+  }
+};
+
+bool moreBitScore(const Hit &x, const Hit &y) {
+  return x.bitScore > y.bitScore;
+}
+
+// Keep only the first hit with each value in this column, like R's
+// x[!duplicated(x$column),]
+void eraseDuplicates(std::vector<Hit> &hits, int column) {
+  std::unordered_set<std::string> seen;
+  size_t j = 0;
+  for (size_t i = 0; i < hits.size(); ++i) {
+    if (!seen.insert(hits[i].fields[column]).second) continue;
+    if (j < i) std::swap(hits[j], hits[i]);
+    ++j;
+  }
+  hits.resize(j);
+}
+
+// Keep the first of the hits with the same query start, and then the
+// first of the remaining hits with the same query end, as argpore.R
+// did.  Then, if a hit overlaps a higher-scoring hit by more than half
+// its length, discard it.
+void resolveOverlaps(std::vector<Hit> &hits) {
+  std::vector<Hit> kept(hits);
+  eraseDuplicates(kept, qStart);
+  eraseDuplicates(kept, qEnd);
+
+  for (size_t i = 0; i < kept.size(); ++i) {  // write as start <= end
+    Row &f = kept[i].fields;
+    if (toNumber(f[qStart]) > toNumber(f[qEnd])) f[qStart].swap(f[qEnd]);
+  }
+
+  std::stable_sort(kept.begin(), kept.end(), moreBitScore);
+
+  hits.clear();
+  for (size_t j = 0; j < kept.size(); ++j) {
+    const Hit &y = kept[j];
+    bool isOverlap = false;
+    for (size_t i = 0; i < j; ++i) {
+      const Hit &x = kept[i];
+      long overlap = std::min(x.end, y.end) - std::max(x.start, y.start);
+      if (overlap > y.length * 0.5) isOverlap = true;
+    }
+    if (!isOverlap) hits.push_back(y);
+  }
+}
+
+// Write the BlastTab columns after the query name, with the gene
+// length before the read length, as ARGpore always has
+void writeHit(std::ostream &out, const Row &f) {
+  for (int i = sName; i < qLength; ++i) out << '\t' << f[i];
+  out << '\t' << f[sLength] << '\t' << f[qLength];
+}
+
+void writeRow(std::ostream &out, const Row &r) {
+  for (size_t i = 0; i < r.size(); ++i) out << '\t' << r[i];
+  out << '\n';
+}
+
+void writeHeader(std::ostream &out, const Row &extraColumns) {
+  out << "query\tsubject\tsimilarity\talign.lenth\tmismatch\tgap\t"
+    "q.start\tq.end\ts.start\ts.end\tevalue\tbitscore\ts.len\tq.len";
+  writeRow(out, extraColumns);
+}
+
+std::ostream &openOutput(const Options &opts, const std::string &suffix,
+			 std::ofstream &file) {
+  return openOut(opts.outPrefix + "_" + suffix, file);
+}
+
+void closeOutput(const Options &opts, const std::string &suffix,
+		 std::ofstream &file) {
+  file.close();
+  if (!file) ERR("can't write file: " + opts.outPrefix + "_" + suffix);
+}
+
+void argporeTabulate(const Options &opts) {
+  Row argHeader, taxaHeader;
+  Table argTable, taxaTable;
+  readTable(opts.argTableName, 3, argHeader, argTable);
+  readTable(opts.taxaTableName, 2, taxaHeader, taxaTable);
+  Row argColumns;
+  argColumns.push_back("subtype");
+  argColumns.push_back("type");
+  Row taxaColumns(taxaHeader.begin() + 1, taxaHeader.end());
+  Row argTaxaColumns(argColumns);
+  argTaxaColumns.insert(argTaxaColumns.end(),
+			taxaColumns.begin(), taxaColumns.end());
+
+  izstream readsFile;
+  std::istream &reads = openIn(opts.readsFileName, readsFile, 1);
+  AlignmentReader argAlignments(opts.argAlignmentsFileName);
+  AlignmentReader markerAlignments(opts.markerAlignmentsFileName);
+
+  std::ofstream argOut, taxaOut, argTaxaOut, typeOut;
+  std::ostream &argTab = openOutput(opts, "arg.tab", argOut);
+  std::ostream &taxaTab = openOutput(opts, "taxa.tab", taxaOut);
+  std::ostream &argTaxaTab = openOutput(opts, "arg.w.taxa.tab", argTaxaOut);
+  writeHeader(argTab, argColumns);
+  writeHeader(taxaTab, taxaColumns);
+  argTaxaTab << "query";
+  writeRow(argTaxaTab, argTaxaColumns);
+
+  std::map<std::string, TypeCount> subtypeCounts;
+  std::vector<Hit> argHits, markerHits;
+  std::string name, read, nextRead;
+  bool isMore = readSequenceName(reads, name);
+
+  while (isMore) {
+    read = readName(name);
+    argHits.clear();
+    markerHits.clear();
+    do {
+      argAlignments.getHits(name, opts, argHits);
+      markerAlignments.getHits(name, opts, markerHits);
+      isMore = readSequenceName(reads, name);
+    } while (isMore && readName(name) == read);
+
+    // The highest-scoring marker hit with known taxa.  Equal scores
+    // are broken by subject name, not input order, as in argpore.R:
+    // there, merge() sorted the hits by subject before the stable
+    // arrange() by bit score.
+    const Hit *bestMarker = 0;
+    const Row *taxa = 0;
+    for (size_t i = 0; i < markerHits.size(); ++i) {
+      const Hit &h = markerHits[i];
+      Table::const_iterator t = taxaTable.find(h.fields[sName]);
+      if (t == taxaTable.end()) continue;
+      if (!bestMarker || h.bitScore > bestMarker->bitScore ||
+	  (h.bitScore == bestMarker->bitScore &&
+	   h.fields[sName] < bestMarker->fields[sName])) {
+	bestMarker = &h;
+	taxa = &t->second;
+      }
+    }
+    if (bestMarker) {
+      taxaTab << read;
+      writeHit(taxaTab, bestMarker->fields);
+      writeRow(taxaTab, *taxa);
+    }
+
+    resolveOverlaps(argHits);
+    for (size_t i = 0; i < argHits.size(); ++i) {
+      const Row &f = argHits[i].fields;
+      Table::const_iterator a = argTable.find(f[sName]);
+      if (a == argTable.end()) continue;
+      const Row &arg = a->second;
+      argTab << read;
+      writeHit(argTab, f);
+      argTab << '\t' << arg[0] << '\t' << arg[1] << '\n';
+      TypeCount &c = subtypeCounts[arg[0]];
+      c.type = arg[1];
+      ++c.count;
+      if (taxa) {
+	argTaxaTab << read << '\t' << arg[0] << '\t' << arg[1];
+	writeRow(argTaxaTab, *taxa);
+      }
+    }
+  }
+
+  if (argAlignments.isMore())
+    ERR("alignment of " + argAlignments.queryName() +
+	" isn't in the same order as the reads");
+  if (markerAlignments.isMore())
+    ERR("alignment of " + markerAlignments.queryName() +
+	" isn't in the same order as the reads");
+
+  std::map<std::string, size_t> typeCounts;
+  std::ostream &subtypeTab = openOutput(opts, "arg.subtype.tab", typeOut);
+  subtypeTab << "subtype\ttype\thits\n";
+  for (std::map<std::string, TypeCount>::const_iterator i =
+	 subtypeCounts.begin(); i != subtypeCounts.end(); ++i) {
+    const TypeCount &c = i->second;
+    subtypeTab << i->first << '\t' << c.type << '\t' << c.count << '\n';
+    typeCounts[c.type] += c.count;
+  }
+  closeOutput(opts, "arg.subtype.tab", typeOut);
+
+  std::ostream &typeTab = openOutput(opts, "arg.type.tab", typeOut);
+  typeTab << "type\thits\n";
+  for (std::map<std::string, size_t>::const_iterator i = typeCounts.begin();
+       i != typeCounts.end(); ++i)
+    typeTab << i->first << '\t' << i->second << '\n';
+  closeOutput(opts, "arg.type.tab", typeOut);
+
+  closeOutput(opts, "arg.tab", argOut);
+  closeOutput(opts, "taxa.tab", taxaOut);
+  closeOutput(opts, "arg.w.taxa.tab", argTaxaOut);
+}
+
+void run(int argc, char *argv[]) {
+  Options opts;
+  opts.minSimilarity = 80;
+  opts.minCoverage = 0.7;
+
+  std::string help = "\
+Usage: " + std::string(argv[0]) + "\
+ [options] reads arg-alignments marker-alignments\n\
+\n\
+Read BlastTab+ alignments of reads to ARG genes and to marker genes (in\n\
+the same order as the reads), and write tables of ARG hits, read taxa,\n\
+and ARG hits with taxa.\n\
+\n\
+Options:\n\
+  -h, --help            show this help message and exit\n\
+  -s PERCENT            minimum similarity (default: "
+    + stringify(opts.minSimilarity) + ")\n\
+  -l FRACTION           minimum aligned fraction of the gene (default: "
+    + stringify(opts.minCoverage) + ")\n\
+  -a FILE               ARG table: gene, subtype, type\n\
+  -t FILE               taxonomy table: gene, taxonomic ranks...\n\
+  -o PREFIX             prefix for output file names (default: reads)\n\
+";
+
+  const char sOpts[] = "hs:l:a:t:o:";
+
+  static struct option lOpts[] = {
+    { "help", no_argument, 0, 'h' },
+    { 0, 0, 0, 0}
+  };
+
+  int c;
+  while ((c = getopt_long(argc, argv, sOpts, lOpts, &c)) != -1) {
+    switch (c) {
+    case 'h':
+      std::cout << help;
+      return;
+    case 's':
+      unstringify(opts.minSimilarity, optarg);
+      break;
+    case 'l':
+      unstringify(opts.minCoverage, optarg);
+      break;
+    case 'a':
+      opts.argTableName = optarg;
+      break;
+    case 't':
+      opts.taxaTableName = optarg;
+      break;
+    case 'o':
+      opts.outPrefix = optarg;
+      break;
+    case '?':
+      ERR("");
+    }
+  }
+
+  if (argc - optind != 3 || opts.argTableName.empty() ||
+      opts.taxaTableName.empty()) {
+    std::cerr << help;
+    ERR("");
+  }
+
+  opts.readsFileName = argv[optind];
+  opts.argAlignmentsFileName = argv[optind + 1];
+  opts.markerAlignmentsFileName = argv[optind + 2];
+  if (opts.outPrefix.empty()) opts.outPrefix = opts.readsFileName;
+
+  std::ios_base::sync_with_stdio(false);  // makes std::cin much faster!!!
+
+  argporeTabulate(opts);
+}
+
+}
+
+int main(int argc, char *argv[]) {
+  try {
+    run(argc, argv);
+    if (!flush(std::cout)) ERR("write error");
+    return EXIT_SUCCESS;
+  } catch (const std::bad_alloc &e) {  // bad_alloc::what() may be unhelpful
+    std::cerr << argv[0] << ": out of memory\n";
+    return EXIT_FAILURE;
+  } catch (const std::exception &e) {
+    const char *s = e.what();
+    if (*s) std::cerr << argv[0] << ": " << s << '\n';
+    return EXIT_FAILURE;
+  }
+}
@@ -0,0 +1,88 @@
+// Copyright 2026 The ARGpore authors
+
+#include "chainSegmentPairs.hh"
+
+#include <algorithm>
+
+namespace cbrc {
+
+// Try at most this many predecessors for each segment pair, so that
+// the run time stays linear when there are many overlapping ones
+static const size_t maxPredecessors = 50;
+
+void chainSegmentPairs(const std::vector<SegmentPair> &items,
+		       std::vector<size_t> &chainIds,
+		       const GeneralizedAffineGapCosts &gapCosts,
+		       size_t maxDistance) {
+  size_t n = items.size();
+  std::vector<size_t> order(n);
+  for (size_t i = 0; i < n; ++i) order[i] = i;
+  std::sort(order.begin(), order.end(), [&](size_t i, size_t j) {
+      const SegmentPair &x = items[i];
+      const SegmentPair &y = items[j];
+      return x.beg1() != y.beg1() ? x.beg1() < y.beg1() : x.beg2() < y.beg2();
+    });
+
+  // For each segment pair in sorted order: the best score of a chain
+  // ending there, and the previous segment pair in that chain
+  std::vector<long> chainScores(n);
+  std::vector<size_t> predecessors(n);
+
+  for (size_t j = 0; j < n; ++j) {
+    const SegmentPair &b = items[order[j]];
+    long bestScore = b.score;
+    size_t bestPredecessor = j;
+    size_t iBeg = (j > maxPredecessors) ? j - maxPredecessors : 0;
+    for (size_t i = j; i-- > iBeg; ) {
+      const SegmentPair &a = items[order[i]];
+      if (b.beg1() - a.beg1() > maxDistance) break;
+      if (a.beg1() == b.beg1() || a.beg2() >= b.beg2()) continue;
+      long gap1 = long(b.beg1()) - long(a.end1());
+      long gap2 = long(b.beg2()) - long(a.end2());
+      if (gap2 > long(maxDistance)) continue;
+      // If b overlaps a, only count b's score for the part after a
+      long overlap = -std::min(gap1, gap2);
+      if (overlap >= long(b.size)) continue;
+      long newScore = (overlap > 0) ?
+	b.score - b.score * overlap / long(b.size) : b.score;
+      long shift = gap1 - gap2;
+      long cost = (shift > 0) ? gapCosts.cost(shift, 0)
+	:         (shift < 0) ? gapCosts.cost(0, -shift) : 0;
+      long s = chainScores[i] + newScore - cost;
+      if (s > bestScore) {
+	bestScore = s;
+	bestPredecessor = i;
+      }
+    }
+    chainScores[j] = bestScore;
+    predecessors[j] = bestPredecessor;
+  }
+
+  // Each segment pair joins its predecessor's chain, which comes
+  // earlier in sorted order
+  std::vector<size_t> sortedChainIds(n);
+  chainIds.resize(n);
+  for (size_t j = 0; j < n; ++j) {
+    size_t p = predecessors[j];
+    sortedChainIds[j] = (p == j) ? j : sortedChainIds[p];
+    chainIds[order[j]] = sortedChainIds[j];
+  }
+}
+
+void ChainCoverage::clear(size_t numOfChains) {
+  size_t n = std::min(boxes.size(), numOfChains);
+  for (size_t i = 0; i < n; ++i) boxes[i].clear();
+  boxes.resize(numOfChains);
+}
+
+bool ChainCoverage::isCovered(size_t chainId, const SegmentPair &sp) const {
+  const std::vector<Box> &v = boxes[chainId];
+  for (size_t i = 0; i < v.size(); ++i) {
+    const Box &b = v[i];
+    if (sp.beg1() >= b.beg1 && sp.end1() <= b.end1 &&
+	sp.beg2() >= b.beg2 && sp.end2() <= b.end2) return true;
+  }
+  return false;
+}
+
+}
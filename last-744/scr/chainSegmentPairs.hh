@@ -0,0 +1,51 @@
+// Copyright 2026 The ARGpore authors
+
+// Co-linear chaining of gapless alignments.  For long, noisy reads,
+// one true alignment often has many gapless alignments along it, on
+// slightly different diagonals.  If we put them in chains, one gapped
+// extension can serve a whole chain.
+
+#ifndef CHAIN_SEGMENT_PAIRS_HH
+#define CHAIN_SEGMENT_PAIRS_HH
+
+#include "GeneralizedAffineGapCosts.hh"
+#include "SegmentPair.hh"
+
+#include <stddef.h>
+#include <vector>
+
+namespace cbrc {
+
+// Put each segment pair in a chain, and set chainIds[i] to the chain
+// number of items[i].  A chain is a series of segment pairs in
+// increasing order in both sequences, found by dynamic programming:
+// its score is the sum of the segment pairs' scores, minus the gap
+// cost for each change of diagonal between neighbours.  If a segment
+// pair overlaps its predecessor, only the fraction of its score for
+// the part after the overlap is counted.  Neighbours must be at most
+// maxDistance apart.
+void chainSegmentPairs(const std::vector<SegmentPair> &items,
+		       std::vector<size_t> &chainIds,
+		       const GeneralizedAffineGapCosts &gapCosts,
+		       size_t maxDistance);
+
+// The ranges of the gapped alignments made from each chain, so that
+// we can skip segment pairs that their chain's alignment covers
+class ChainCoverage {
+public:
+  // Forget all the ranges, and allow chain ids < numOfChains
+  void clear(size_t numOfChains);
+
+  void add(size_t chainId, size_t beg1, size_t end1, size_t beg2, size_t end2)
+  { Box b = { beg1, end1, beg2, end2 };  boxes[chainId].push_back(b); }
+
+  bool isCovered(size_t chainId, const SegmentPair &sp) const;
+
+private:
+  struct Box { size_t beg1, end1, beg2, end2; };
+  std::vector< std::vector<Box> > boxes;  // for each chain
+};
+
+}
+
+#endif
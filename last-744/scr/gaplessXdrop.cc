@@ -7,6 +7,12 @@ static void err(const char *s) { throw std::overflow_error(s); }
 
 namespace cbrc {
 
+// These loops are deliberately scalar.  Block-wise SIMD versions
+// (prefix sums and running maxima over 4 or 8 columns) were no faster:
+// the cost is dominated by the per-column score lookup, and the
+// scores must be gathered one by one so as not to read past the
+// sentinels.
+
 int forwardGaplessXdropScore(const uchar *seq1,
                              const uchar *seq2,
                              const ScoreMatrixRow *scorer,
@@ -0,0 +1,488 @@
+// Copyright 2026 The ARGpore authors
+
+// Micro-benchmarks for lastal's alignment kernels.  The inputs are
+// random DNA sequences, paired with copies mutated like nanopore
+// reads: substitutions, and insertions and deletions of geometric
+// lengths.  The same seed gives the same inputs, so the speed of
+// kernel changes can be compared without running whole pipelines.
+
+#include "AlignmentPot.hh"
+#include "Centroid.hh"
+#include "GappedXdropAligner.hh"
+#include "GeneralizedAffineGapCosts.hh"
+#include "GreedyXdropAligner.hh"
+#include "LambdaCalculator.hh"
+#include "TwoQualityScoreMatrix.hh"
+#include "gaplessXdrop.hh"
+#include "io.hh"
+#include "stringify.hh"
+
+#include <getopt.h>
+#include <time.h>  // clock_gettime
+#include <algorithm>  // min
+#include <cstdlib>  // EXIT_SUCCESS, EXIT_FAILURE
+#include <functional>
+#include <iostream>
+#include <new>  // bad_alloc
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#define ERR(x) throw std::runtime_error(x)
+
+using namespace cbrc;
+
+namespace {
+
+struct Options {
+  size_t length;  // letters in each unmutated sequence
+  double identity;  // probability that a letter is copied without error
+  double indelFraction;  // fraction of errors that are insertions/deletions
+  double indelExtension;  // probability of extending an insertion/deletion
+  unsigned numOfPairs;
+  unsigned rounds;
+  unsigned long seed;
+  int matchScore;
+  int mismatchCost;
+  int gapExistCost;
+  int gapExtendCost;
+  int maxDrop;
+  std::string only;  // only run benchmarks whose names contain this
+};
+
+enum { dnaSize = 4, proteinSize = 20 };
+
+// The letters are 0 to alphabet size - 1, and the alphabet size
+// codes for a delimiter, which scores -INF against everything
+
+struct SequencePair {
+  std::vector<uchar> seq1;  // with a delimiter at each end
+  std::vector<uchar> seq2;
+  std::vector<uchar> qual1;  // fastq-sanger quality codes
+  std::vector<uchar> qual2;
+  std::vector<int> pssm2;  // for seq2: scoreMatrixRowSize per letter
+  std::vector<uchar> seq2frame1;  // for 3-frame alignment
+  std::vector<uchar> seq2frame2;
+
+  const ScoreMatrixRow *pssm2Reader() const
+  { return reinterpret_cast<const ScoreMatrixRow *>(&pssm2[0]); }
+};
+
+struct Cost {
+  double seconds;
+  unsigned long long cells;  // DP cells, or letters for gapless
+};
+
+typedef std::function<Cost(const SequencePair &)> Kernel;
+
+typedef std::mt19937 Random;  // gives the same numbers on every platform
+
+double uniform(Random &r) {
+  return r() / 4294967296.0;
+}
+
+double now() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+void appendRandom(Random &r, unsigned alphSize, size_t length,
+		  std::vector<uchar> &out) {
+  for (size_t i = 0; i < length; ++i) out.push_back(r() % alphSize);
+}
+
+// Append a copy of [beg, end) with nanopore-like errors
+void appendMutated(Random &r, const Options &opts, unsigned alphSize,
+		   const uchar *beg, const uchar *end,
+		   std::vector<uchar> &out) {
+  for (const uchar *i = beg; i < end; ++i) {
+    if (uniform(r) < opts.identity) {
+      out.push_back(*i);
+    } else if (uniform(r) >= opts.indelFraction) {  // substitution
+      out.push_back((*i + 1 + r() % (alphSize - 1)) % alphSize);
+    } else if (r() % 2) {  // insertion
+      do out.push_back(r() % alphSize);
+      while (uniform(r) < opts.indelExtension);
+      out.push_back(*i);
+    } else {  // deletion
+      while (i + 1 < end && uniform(r) < opts.indelExtension) ++i;
+    }
+  }
+}
+
+void makePair(Random &r, const Options &opts, unsigned alphSize,
+	      SequencePair &p) {
+  uchar delimiter = alphSize;
+
+  p.seq1.assign(1, delimiter);
+  appendRandom(r, alphSize, opts.length, p.seq1);
+  p.seq2.assign(1, delimiter);
+  appendMutated(r, opts, alphSize, &p.seq1[1], &p.seq1[0] + p.seq1.size(),
+		p.seq2);
+  p.seq1.push_back(delimiter);
+  p.seq2.push_back(delimiter);
+
+  p.qual1.assign(p.seq1.size(), '!' + 40);
+  for (size_t i = 0; i < p.seq2.size(); ++i)
+    p.qual2.push_back('!' + 5 + r() % 26);
+
+  // for 3-frame alignment, the other 2 frames look random:
+  p.seq2frame1.assign(1, delimiter);
+  appendRandom(r, alphSize, p.seq2.size() - 2, p.seq2frame1);
+  p.seq2frame1.push_back(delimiter);
+  p.seq2frame2.assign(1, delimiter);
+  appendRandom(r, alphSize, p.seq2.size() - 2, p.seq2frame2);
+  p.seq2frame2.push_back(delimiter);
+}
+
+void makeMatrix(unsigned alphSize, int matchScore, int mismatchCost,
+		ScoreMatrixRow *matrix) {
+  for (int i = 0; i < scoreMatrixRowSize; ++i)
+    for (int j = 0; j < scoreMatrixRowSize; ++j)
+      matrix[i][j] = (i < int(alphSize) && j < int(alphSize))
+	? (i == j ? matchScore : -mismatchCost) : -INF;
+}
+
+void makePssm(const ScoreMatrixRow *matrix, SequencePair &p) {
+  p.pssm2.resize(p.seq2.size() * scoreMatrixRowSize);
+  for (size_t i = 0; i < p.seq2.size(); ++i)
+    std::copy(matrix[p.seq2[i]], matrix[p.seq2[i]] + scoreMatrixRowSize,
+	      &p.pssm2[i * scoreMatrixRowSize]);
+}
+
+// Make alignments ending at a few random places, so that many share
+// endpoints
+void makeAlignmentPot(Random &r, size_t length, AlignmentPot &pot) {
+  size_t numOfAlignments = length / 10 + 1;
+  size_t numOfEnds = numOfAlignments / 2 + 1;
+  for (size_t i = 0; i < numOfAlignments; ++i) {
+    Alignment a;
+    SegmentPair::indexT beg = r() % numOfEnds;
+    SegmentPair::indexT size = 1 + r() % numOfEnds;
+    a.blocks.push_back(SegmentPair(beg, beg, size));
+    a.seed = a.blocks[0];
+    a.score = r() % 100 + 1;
+    pot.add(a);
+  }
+}
+
+void runBenchmark(const Options &opts, const char *name,
+		  const std::vector<SequencePair> &pairs,
+		  const Kernel &kernel) {
+  if (std::string(name).find(opts.only) == std::string::npos) return;
+  double bestSeconds = 0;
+  unsigned long long cells = 0;
+  for (unsigned round = 0; round < opts.rounds; ++round) {
+    Cost total = { 0, 0 };
+    for (size_t i = 0; i < pairs.size(); ++i) {
+      Cost c = kernel(pairs[i]);
+      total.seconds += c.seconds;
+      total.cells += c.cells;
+    }
+    if (round == 0 || total.seconds < bestSeconds) bestSeconds = total.seconds;
+    cells = total.cells;
+  }
+  std::cout << name << '\t' << pairs.size() << '\t'
+	    << bestSeconds / pairs.size() * 1e9 << '\t';
+  if (cells) std::cout << cells / bestSeconds / 1e6;
+  else std::cout << '-';
+  std::cout << '\n';
+}
+
+void runAll(const Options &opts) {
+  Random random(opts.seed);
+
+  ScoreMatrixRow dnaMatrix[scoreMatrixRowSize];
+  makeMatrix(dnaSize, opts.matchScore, opts.mismatchCost, dnaMatrix);
+  GeneralizedAffineGapCosts gap;
+  gap.assign(opts.gapExistCost, opts.gapExtendCost,
+	     opts.gapExistCost, opts.gapExtendCost, 0);
+  int maxDrop = opts.maxDrop;
+  int maxScore = opts.matchScore;
+
+  LambdaCalculator lambdaCalculator;
+  lambdaCalculator.calculate(dnaMatrix, dnaSize);
+  if (lambdaCalculator.isBad()) ERR("can't calculate lambda for the scores");
+  double lambda = lambdaCalculator.lambda();
+
+  std::vector<SequencePair> pairs(opts.numOfPairs);
+  std::vector<AlignmentPot> pots(opts.numOfPairs);
+  for (size_t i = 0; i < pairs.size(); ++i) {
+    makePair(random, opts, dnaSize, pairs[i]);
+    makePssm(dnaMatrix, pairs[i]);
+    makeAlignmentPot(random, opts.length, pots[i]);
+  }
+
+  // A simple protein-like scoring scheme, for 3-frame alignment
+  ScoreMatrixRow proteinMatrix[scoreMatrixRowSize];
+  makeMatrix(proteinSize, 5, 2, proteinMatrix);
+  std::vector<SequencePair> proteinPairs(opts.numOfPairs);
+  for (size_t i = 0; i < proteinPairs.size(); ++i)
+    makePair(random, opts, proteinSize, proteinPairs[i]);
+
+  std::vector<uchar> toUnmasked(scoreMatrixRowSize);
+  for (int i = 0; i < scoreMatrixRowSize; ++i) toUnmasked[i] = i;
+  TwoQualityScoreMatrix twoQualityMatrix;
+  twoQualityMatrix.init(dnaMatrix, lambda, lambdaCalculator.letterProbs1(),
+			lambdaCalculator.letterProbs2(), true, '!', true, '!',
+			&toUnmasked[0], false);
+
+  Centroid centroid;
+  centroid.setScoreMatrix(dnaMatrix, 1 / lambda);
+  centroid.setOutputType(5);
+  GappedXdropAligner &aligner = centroid.aligner();
+  GreedyXdropAligner greedyAligner;
+  // The greedy aligner needs an even match score: doubling all the
+  // scores doesn't change the alignments
+  ScoreMatrixRow greedyMatrix[scoreMatrixRowSize];
+  makeMatrix(dnaSize, opts.matchScore * 2, opts.mismatchCost * 2,
+	     greedyMatrix);
+
+  std::cout << "# last-bench: " << opts.numOfPairs << " pairs of "
+	    << opts.length << " letters, identity=" << opts.identity
+	    << " indel-fraction=" << opts.indelFraction
+	    << " indel-extension=" << opts.indelExtension
+	    << " seed=" << opts.seed << " rounds=" << opts.rounds << '\n'
+	    << "# r=" << opts.matchScore << " q=" << opts.mismatchCost
+	    << " a=" << opts.gapExistCost << " b=" << opts.gapExtendCost
+	    << " x=" << opts.maxDrop << '\n'
+	    << "# kernel\tcalls\tns/call\tMcells/s\n";
+
+  // Gapless: extend both ways from the middle, like from a seed
+  runBenchmark(opts, "gaplessXdrop", pairs, [&](const SequencePair &p) {
+    double t = now();
+    size_t mid = std::min(p.seq1.size(), p.seq2.size()) / 2;
+    const uchar *s1 = &p.seq1[mid];
+    const uchar *s2 = &p.seq2[mid];
+    int fs = forwardGaplessXdropScore(s1, s2, dnaMatrix, maxDrop);
+    int rs = reverseGaplessXdropScore(s1, s2, dnaMatrix, maxDrop);
+    const uchar *e = forwardGaplessXdropEnd(s1, s2, dnaMatrix, fs);
+    const uchar *b = reverseGaplessXdropEnd(s1, s2, dnaMatrix, rs);
+    Cost c = { now() - t, static_cast<unsigned long long>(e - b) };
+    return c;
+  });
+
+  // Gapped: extend forwards from the start
+  runBenchmark(opts, "align", pairs, [&](const SequencePair &p) {
+    unsigned long long oldCells = aligner.totalCellsAndPads();
+    double t = now();
+    aligner.align(&p.seq1[1], &p.seq2[1], true, 0, dnaMatrix,
+		  gap.delExist, gap.delExtend, gap.insExist, gap.insExtend,
+		  gap.pairExtend, maxDrop, maxScore);
+    Cost c = { now() - t, aligner.totalCellsAndPads() - oldCells };
+    return c;
+  });
+
+  runBenchmark(opts, "alignPssm", pairs, [&](const SequencePair &p) {
+    unsigned long long oldCells = aligner.totalCellsAndPads();
+    double t = now();
+    aligner.alignPssm(&p.seq1[1], p.pssm2Reader() + 1, true, 0,
+		      gap.delExist, gap.delExtend, gap.insExist, gap.insExtend,
+		      gap.pairExtend, maxDrop, maxScore);
+    Cost c = { now() - t, aligner.totalCellsAndPads() - oldCells };
+    return c;
+  });
+
+  runBenchmark(opts, "align2qual", pairs, [&](const SequencePair &p) {
+    unsigned long long oldCells = aligner.totalCellsAndPads();
+    double t = now();
+    aligner.align2qual(&p.seq1[1], &p.qual1[1], &p.seq2[1], &p.qual2[1],
+		       true, 0, twoQualityMatrix,
+		       gap.delExist, gap.delExtend, gap.insExist, gap.insExtend,
+		       gap.pairExtend, maxDrop, maxScore);
+    Cost c = { now() - t, aligner.totalCellsAndPads() - oldCells };
+    return c;
+  });
+
+  runBenchmark(opts, "align3", proteinPairs, [&](const SequencePair &p) {
+    unsigned long long oldCells = aligner.totalCellsAndPads();
+    double t = now();
+    aligner.align3(&p.seq1[1], &p.seq2[1], &p.seq2frame1[1],
+		   &p.seq2frame2[1], true, proteinMatrix, 11, 2, 1000000000,
+		   15, 40, 5);
+    Cost c = { now() - t, aligner.totalCellsAndPads() - oldCells };
+    return c;
+  });
+
+  runBenchmark(opts, "greedy", pairs, [&](const SequencePair &p) {
+    double t = now();
+    greedyAligner.align(&p.seq1[1], &p.seq2[1], true, greedyMatrix,
+			maxDrop * 2, dnaSize);
+    Cost c = { now() - t, 0 };
+    return c;
+  });
+
+  // Centroid stages: the earlier stages are done, but not timed
+  const char *centroidNames[] = { "centroid-forward", "centroid-backward",
+				  "centroid-dp" };
+  for (int stage = 0; stage < 3; ++stage) {
+    runBenchmark(opts, centroidNames[stage], pairs,
+		 [&](const SequencePair &p) {
+      unsigned long long oldCells = aligner.totalCellsAndPads();
+      aligner.align(&p.seq1[1], &p.seq2[1], true, 0, dnaMatrix,
+		    gap.delExist, gap.delExtend, gap.insExist, gap.insExtend,
+		    gap.pairExtend, maxDrop, maxScore);
+      centroid.reset();
+      double t[4];
+      t[0] = now();
+      centroid.forward(&p.seq1[0], &p.seq2[0], 1, 1, true, 0, gap);
+      t[1] = now();
+      if (stage > 0)
+	centroid.backward(&p.seq1[0], &p.seq2[0], 1, 1, true, 0, gap);
+      t[2] = now();
+      if (stage > 1) centroid.dp(1);
+      t[3] = now();
+      Cost c = { t[stage + 1] - t[stage],
+		 aligner.totalCellsAndPads() - oldCells };
+      return c;
+    });
+  }
+
+  size_t potNum = 0;
+  runBenchmark(opts, "eraseSuboptimal", pairs, [&](const SequencePair &) {
+    AlignmentPot pot = pots[potNum++ % pots.size()];
+    double t = now();
+    pot.eraseSuboptimal();
+    Cost c = { now() - t, 0 };
+    return c;
+  });
+}
+
+void run(int argc, char **argv) {
+  Options opts;
+  opts.length = 10000;
+  opts.identity = 0.9;
+  opts.indelFraction = 0.6;
+  opts.indelExtension = 0.3;
+  opts.numOfPairs = 20;
+  opts.rounds = 5;
+  opts.seed = 1;
+  opts.matchScore = 1;
+  opts.mismatchCost = 1;
+  opts.gapExistCost = 1;
+  opts.gapExtendCost = 1;
+  opts.maxDrop = 30;
+
+  std::string help = "\
+Usage: " + std::string(argv[0]) + " [options]\n\
+\n\
+Time lastal's alignment kernels on synthetic nanopore-like sequence pairs,\n\
+and write the fastest round's nanoseconds per call, and millions of DP\n\
+cells (letters, for gapless) per second.\n\
+\n\
+Options:\n\
+  -h, --help            show this help message and exit\n\
+  -n LETTERS            length of each sequence (default: "
+    + stringify(opts.length) + ")\n\
+  -i FRACTION           identity: probability of no error at each letter\n\
+                        (default: " + stringify(opts.identity) + ")\n\
+  -d FRACTION           fraction of errors that are insertions or deletions\n\
+                        (default: " + stringify(opts.indelFraction) + ")\n\
+  -e FRACTION           probability of extending an insertion or deletion\n\
+                        (default: " + stringify(opts.indelExtension) + ")\n\
+  -p COUNT              number of sequence pairs (default: "
+    + stringify(opts.numOfPairs) + ")\n\
+  -R COUNT              number of timing rounds (default: "
+    + stringify(opts.rounds) + ")\n\
+  -s NUMBER             random seed (default: " + stringify(opts.seed) + ")\n\
+  -r SCORE              match score (default: "
+    + stringify(opts.matchScore) + ")\n\
+  -q COST               mismatch cost (default: "
+    + stringify(opts.mismatchCost) + ")\n\
+  -a COST               gap existence cost (default: "
+    + stringify(opts.gapExistCost) + ")\n\
+  -b COST               gap extension cost (default: "
+    + stringify(opts.gapExtendCost) + ")\n\
+  -x DROP               maximum score drop (default: "
+    + stringify(opts.maxDrop) + ")\n\
+  -k NAME               only run kernels whose names contain NAME\n\
+\n\
+3-frame alignment (align3) uses a toy protein scoring scheme:\n\
+match=5 mismatch=-2 a=11 b=2 frameshift=15 x=40.\n\
+";
+
+  const char sOpts[] = "hn:i:d:e:p:R:s:r:q:a:b:x:k:";
+
+  static struct option lOpts[] = {
+    { "help", no_argument, 0, 'h' },
+    { 0, 0, 0, 0}
+  };
+
+  int c;
+  while ((c = getopt_long(argc, argv, sOpts, lOpts, &c)) != -1) {
+    switch (c) {
+    case 'h':
+      std::cout << help;
+      return;
+    case 'n':
+      unstringify(opts.length, optarg);
+      break;
+    case 'i':
+      unstringify(opts.identity, optarg);
+      break;
+    case 'd':
+      unstringify(opts.indelFraction, optarg);
+      break;
+    case 'e':
+      unstringify(opts.indelExtension, optarg);
+      if (opts.indelExtension >= 1) ERR(std::string("bad option value: -e ") + optarg);
+      break;
+    case 'p':
+      unstringify(opts.numOfPairs, optarg);
+      break;
+    case 'R':
+      unstringify(opts.rounds, optarg);
+      break;
+    case 's':
+      unstringify(opts.seed, optarg);
+      break;
+    case 'r':
+      unstringify(opts.matchScore, optarg);
+      break;
+    case 'q':
+      unstringify(opts.mismatchCost, optarg);
+      break;
+    case 'a':
+      unstringify(opts.gapExistCost, optarg);
+      break;
+    case 'b':
+      unstringify(opts.gapExtendCost, optarg);
+      break;
+    case 'x':
+      unstringify(opts.maxDrop, optarg);
+      break;
+    case 'k':
+      opts.only = optarg;
+      break;
+    case '?':
+      ERR("");
+    }
+  }
+
+  if (optind < argc || opts.length < 1 || opts.numOfPairs < 1 ||
+      opts.rounds < 1) {
+    std::cerr << help;
+    ERR("");
+  }
+
+  runAll(opts);
+}
+
+}
+
+int main(int argc, char *argv[]) {
+  try {
+    run(argc, argv);
+    if (!flush(std::cout)) ERR("write error");
+    return EXIT_SUCCESS;
+  } catch (const std::bad_alloc &e) {  // bad_alloc::what() may be unhelpful
+    std::cerr << argv[0] << ": out of memory\n";
+    return EXIT_FAILURE;
+  } catch (const std::exception &e) {
+    const char *s = e.what();
+    if (*s) std::cerr << argv[0] << ": " << s << '\n';
+    return EXIT_FAILURE;
+  }
+}
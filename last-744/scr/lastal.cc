@@ -3,6 +3,7 @@
 // BLAST-like pair-wise sequence alignment, using suffix arrays.
 
 #include "LastalArguments.hh"
+#include "AlignmentFilter.hh"
 #include "QualityPssmMaker.hh"
 #include "OneQualityScoreMatrix.hh"
 #include "TwoQualityScoreMatrix.hh"
@@ -27,14 +28,32 @@
 #include "gaplessXdrop.hh"
 #include "gaplessPssmXdrop.hh"
 #include "gaplessTwoQualityXdrop.hh"
+#include "chainSegmentPairs.hh"
 #include "io.hh"
 #include "stringify.hh"
 #include "threadUtil.hh"
+#include "WorkStealingPool.hh"
+#include "OutputWriter.hh"
+#include "LastalStats.hh"
+#include "zio.hh"
+#include <algorithm>  // lower_bound, upper_bound, min_element
+#include <atomic>
+#include <climits>  // INT_MIN
+#include <cmath>  // ceil
 #include <iomanip>  // setw
 #include <iostream>
 #include <fstream>
+#include <map>
+#include <set>
 #include <stdexcept>
+#include <cstdio>  // fopen, remove
 #include <cstdlib>  // EXIT_SUCCESS, EXIT_FAILURE
+#include <cstring>  // strlen
+#include <dirent.h>  // opendir
+#include <poll.h>
+#include <signal.h>  // sigaction
+#include <sys/stat.h>
+#include <unistd.h>  // fsync, sleep
 
 #define ERR(x) throw std::runtime_error(x)
 #define LOG(x) if( args.verbosity > 0 ) std::cerr << args.programName << ": " << x << '\n'
@@ -46,33 +65,91 @@ static void warn( const char* programName, const char* s ){
 
 using namespace cbrc;
 
+struct SavedExtensions {  // the gapped extensions of one final alignment
+  SegmentPair seed;
+  GappedExtension extensions[2];  // reverse, forward
+};
+
 struct LastAligner {  // data that changes between queries
   Centroid centroid;
   GreedyXdropAligner greedyAligner;
   std::vector<int> qualityPssm;
   std::vector<AlignmentText> textAlns;
+  std::vector<int> bestScores;  // best so far, for --best-per-query
+  TextArena textArena;  // holds textAlns' text until the batch is written
+  TextArena oldTextArena;  // the previous batch's text, maybe being written
+  ThreadStats stats;
+  SegmentPairPot gaplessAlns;  // re-used for each query, to avoid reallocation
+  AlignmentPot gappedAlns;
+  std::vector<size_t> chainIds;  // for --chain
+  ChainCoverage chainCoverage;
+  SavedExtensions newExtensions;  // for -j > 3
+  std::vector<SavedExtensions> savedExtensions;  // for -j > 3
+  size_t savedShapeSize = 0;  // total size of the saved extensions' shapes
 };
 
 namespace {
   typedef MultiSequence::indexT indexT;
   typedef unsigned long long countT;
 
+  const unsigned maxNumOfIndexes = 16;
+  std::vector<LastAligner> aligners;
+  WorkStealingPool threadPool;  // runs one query at a time with each aligner
+#ifdef HAS_CXX_THREADS
+  std::mutex outputMutex;
+#endif
+  MultiSequence query;  // sequence that hasn't been indexed by lastdb
+  MultiSequence nextQuery;  // the next batch, read while query is aligned
+  OutputWriter stdoutWriter;
+  bool isQueryReversed;  // is the query batch reverse-complemented now?
+  StatsFile statsFile;
+  countT currentBatchNum;  // for progress snapshots
+  std::atomic<bool> isProgressWanted(false);  // set by SIGUSR1
+  std::atomic<bool> isStopWanted(false);  // set by SIGTERM or SIGINT
+}
+
+static void requestProgress( int ){
+  isProgressWanted = true;
+}
+
+static void requestStop( int ){
+  isStopWanted = true;
+}
+
+static StatsTotals totalStats(){
+  StatsTotals t;
+  for( size_t i = 0; i < aligners.size(); ++i ) t.add( aligners[i].stats );
+  return t;
+}
+
+// Write a progress snapshot, if SIGUSR1 asked for one.  This must not
+// run in 2 threads at once.
+static void writeProgressIfWanted(){
+  if( isProgressWanted.exchange( false ) && statsFile.isOpen() )
+    statsFile.writeProgress( currentBatchNum, totalStats() );
+}
+
+namespace Phase{ enum Enum{ gapless, gapped, final }; }
+
+struct Dispatcher;
+
+// A lastdb database, with everything needed to align queries to it.
+// Each batch of queries can be aligned to several of these.
+struct Database{
   LastalArguments args;
   Alphabet alph;
   Alphabet queryAlph;  // for translated alignment
   TantanMasker tantanMasker;
   GeneticCode geneticCode;
-  const unsigned maxNumOfIndexes = 16;
   SubsetSuffixArray suffixArrays[maxNumOfIndexes];
   ScoreMatrix scoreMatrix;
   int scoreMatrixRev[scoreMatrixRowSize][scoreMatrixRowSize];
   int scoreMatrixRevMasked[scoreMatrixRowSize][scoreMatrixRowSize];
   GeneralizedAffineGapCosts gapCosts;
-  std::vector<LastAligner> aligners;
   LambdaCalculator lambdaCalculator;
   LastEvaluer evaluer;
-  MultiSequence query;  // sequence that hasn't been indexed by lastdb
   MultiSequence text;  // sequence that has been indexed by lastdb
+  AlignmentFilter alignmentFilter;
   std::vector< std::vector<countT> > matchCounts;  // used if outputType == 0
   OneQualityScoreMatrix oneQualityMatrix;
   OneQualityScoreMatrix oneQualityMatrixMasked;
@@ -82,24 +159,113 @@ namespace {
   OneQualityExpMatrix oneQualityExpMatrixRev;
   QualityPssmMaker qualityPssmMaker;
   QualityPssmMaker qualityPssmMakerRev;
-  sequenceFormat::Enum referenceFormat;  // defaults to 0
+  sequenceFormat::Enum referenceFormat = sequenceFormat::fasta;
   TwoQualityScoreMatrix twoQualityMatrix;
   TwoQualityScoreMatrix twoQualityMatrixMasked;
   TwoQualityScoreMatrix twoQualityMatrixRev;
   TwoQualityScoreMatrix twoQualityMatrixRevMasked;
-  int minScoreGapless;
+  int minScoreGapless = 0;
   int isCaseSensitiveSeeds = -1;  // initialize it to an "error" value
   unsigned numOfIndexes = 1;  // assume this value, if unspecified
-}
+  unsigned volumes = unsigned(-1);
+  countT refSequences = -1;
+  countT refLetters = -1;
+  OutputWriter outFileWriter;
+  OutputWriter* out = &stdoutWriter;  // where we write the alignments
+  unsigned long long previousBatchEnd = 0;  // out's position after it
+  std::vector< std::vector<AlignmentText> > queryAlns;  // not yet written
+  std::vector<char> isQueryFinished;  // done with the current volume?
+  size_t numOfPrintedQueries = 0;
+
+  void setUp( int argc, char** argv, const std::string& spec );
+  void argsFromCommandLine( int argc, char** argv, const std::string& name,
+			    const std::string& options );
+  void complementMatrix(const ScoreMatrixRow *from, ScoreMatrixRow *to);
+  void makeScoreMatrix( const std::string& matrixName,
+			const std::string& matrixFile );
+  void permuteComplement(const double *from, double *to);
+  void makeQualityScorers();
+  void calculateScoreStatistics( const std::string& matrixName,
+				 countT refLetters );
+  void readOuterPrj( const std::string& fileName, unsigned& volumes,
+		     indexT& refMinimizerWindow, indexT& minSeedLimit,
+		     bool& isKeepRefLowercase, int& refTantanSetting,
+		     countT& refSequences, countT& refLetters );
+  void readInnerPrj( const std::string& fileName,
+		     indexT& seqCount, indexT& seqLen );
+  void writeCounts( std::ostream& out );
+  void countMatches( size_t queryNum, const uchar* querySeq );
+  const ScoreMatrixRow *getScoreMatrix(char strand, bool isMask) const;
+  const OneQualityScoreMatrix &getOneQualityMatrix(char strand,
+						   bool isMask) const;
+  const TwoQualityScoreMatrix &getTwoQualityMatrix(char strand,
+						   bool isMask) const;
+  const OneQualityExpMatrix &getOneQualityExpMatrix(char strand) const;
+  const QualityPssmMaker &getQualityPssmMaker(char strand) const;
+  const ScoreMatrixRow *getQueryPssm(const LastAligner &aligner,
+				     size_t queryNum) const;
+  bool isMaskLowercase(Phase::Enum e) const;
+  bool isCollatedAlignments() const;
+  void writeAlignment(LastAligner &aligner, const Alignment &aln,
+		      size_t queryNum, char strand, const uchar* querySeq,
+		      const AlignmentExtras &extras = AlignmentExtras());
+  void alignGapless( LastAligner& aligner, SegmentPairPot& gaplessAlns,
+		     size_t queryNum, char strand, const uchar* querySeq );
+  void shrinkToLongestIdenticalRun( SegmentPair& sp,
+				    const Dispatcher& dis ) const;
+  bool isPruningGapped( const Dispatcher& dis ) const;
+  double maxGappedScore( const SegmentPair& seed, size_t queryNum ) const;
+  void addBestScore( LastAligner& aligner, int score ) const;
+  int bestScoresMin( const LastAligner& aligner ) const;
+  void alignGapped( LastAligner& aligner,
+		    AlignmentPot& gappedAlns, SegmentPairPot& gaplessAlns,
+		    size_t queryNum, char strand, const uchar* querySeq,
+		    Phase::Enum phase );
+  void alignFinish( LastAligner& aligner, const AlignmentPot& gappedAlns,
+		    size_t queryNum, char strand, const uchar* querySeq );
+  void eraseWeakAlignments(LastAligner &aligner, AlignmentPot &gappedAlns,
+			   size_t queryNum, char strand,
+			   const uchar *querySeq);
+  void cullFinalAlignments(std::vector<AlignmentText> &textAlns,
+			   size_t start);
+  void cullOverlappingAlignments(std::vector<AlignmentText> &textAlns,
+				 size_t start);
+  void keepBestPerQuery(std::vector<AlignmentText> &textAlns, size_t start);
+  void printAndClear(std::vector<AlignmentText> &textAlns);
+  void printFinishedQueries(size_t queryNum);
+  void makeQualityPssm( LastAligner& aligner,
+			size_t queryNum, char strand, const uchar* querySeq,
+			bool isMask );
+  void scan( LastAligner& aligner,
+	     size_t queryNum, char strand, const uchar* querySeq );
+  void tantanMaskOneQuery(size_t queryNum, uchar *querySeq);
+  void tantanMaskTranslatedQuery(size_t queryNum, uchar *querySeq);
+  void translateAndScan( LastAligner& aligner, size_t queryNum, char strand );
+  void reverseComplementPssm( size_t queryNum );
+  void reverseComplementQuery( size_t queryNum );
+  void alignOneQuery(LastAligner &aligner, size_t queryNum, bool isReversed);
+  void alignQueryToVolume(LastAligner &aligner, size_t queryNum,
+			  unsigned volume, unsigned volumeCount);
+  void scanOneVolume(unsigned volume, unsigned volumeCount);
+  void readIndex( const std::string& baseName, indexT seqCount );
+  void readVolume( unsigned volumeNumber );
+  void scanAllVolumes( unsigned volumes );
+  void scanBatch( countT queryBatchNum );
+  void writeHeader( countT refSequences, countT refLetters,
+		    std::ostream& out );
+  std::istream& appendFromFasta( MultiSequence& batch,
+				 std::istream& in ) const;
+};
 
-void complementMatrix(const ScoreMatrixRow *from, ScoreMatrixRow *to) {
+void Database::complementMatrix(const ScoreMatrixRow *from,
+				ScoreMatrixRow *to) {
   for (unsigned i = 0; i < scoreMatrixRowSize; ++i)
     for (unsigned j = 0; j < scoreMatrixRowSize; ++j)
       to[i][j] = from[alph.complement[i]][alph.complement[j]];
 }
 
 // Set up a scoring matrix, based on the user options
-void makeScoreMatrix( const std::string& matrixName,
+void Database::makeScoreMatrix( const std::string& matrixName,
 		      const std::string& matrixFile ){
   if( !matrixName.empty() && !args.isGreedy ){
     scoreMatrix.fromString( matrixFile );
@@ -125,13 +291,13 @@ void makeScoreMatrix( const std::string& matrixName,
   }
 }
 
-void permuteComplement(const double *from, double *to) {
+void Database::permuteComplement(const double *from, double *to) {
   if (from)
     for (unsigned i = 0; i < alph.size; ++i)
       to[i] = from[alph.complement[i]];
 }
 
-void makeQualityScorers(){
+void Database::makeQualityScorers(){
   if( args.isGreedy ) return;
 
   if( args.isTranslated() )
@@ -230,7 +396,7 @@ void makeQualityScorers(){
 
 // Calculate statistical parameters for the alignment scoring scheme
 // Meaningless for PSSMs, unless they have the same scale as the score matrix
-void calculateScoreStatistics( const std::string& matrixName,
+void Database::calculateScoreStatistics( const std::string& matrixName,
 			       countT refLetters ){
   LOG( "calculating matrix probabilities..." );
   // the case-sensitivity of the matrix makes no difference here
@@ -287,7 +453,7 @@ void calculateScoreStatistics( const std::string& matrixName,
 }
 
 // Read the .prj file for the whole database
-void readOuterPrj( const std::string& fileName, unsigned& volumes,
+void Database::readOuterPrj( const std::string& fileName, unsigned& volumes,
                    indexT& refMinimizerWindow, indexT& minSeedLimit,
 		   bool& isKeepRefLowercase, int& refTantanSetting,
                    countT& refSequences, countT& refLetters ){
@@ -330,7 +496,7 @@ void readOuterPrj( const std::string& fileName, unsigned& volumes,
 }
 
 // Read a per-volume .prj file, with info about a database volume
-void readInnerPrj( const std::string& fileName,
+void Database::readInnerPrj( const std::string& fileName,
 		   indexT& seqCount, indexT& seqLen ){
   std::ifstream f( fileName.c_str() );
   if( !f ) ERR( "can't open file: " + fileName );
@@ -352,7 +518,7 @@ void readInnerPrj( const std::string& fileName,
 }
 
 // Write match counts for each query sequence
-void writeCounts( std::ostream& out ){
+void Database::writeCounts( std::ostream& out ){
   for( indexT i = 0; i < matchCounts.size(); ++i ){
     out << query.seqName(i) << '\n';
 
@@ -365,7 +531,7 @@ void writeCounts( std::ostream& out ){
 }
 
 // Count all matches, of all sizes, of a query sequence against a suffix array
-void countMatches( size_t queryNum, const uchar* querySeq ){
+void Database::countMatches( size_t queryNum, const uchar* querySeq ){
   indexT loopBeg = query.seqBeg(queryNum) - query.padBeg(queryNum);
   indexT loopEnd = query.seqEnd(queryNum) - query.padBeg(queryNum);
   if( args.minHitDepth > 1 )
@@ -378,35 +544,38 @@ void countMatches( size_t queryNum, const uchar* querySeq ){
   }
 }
 
-const ScoreMatrixRow *getScoreMatrix(char strand, bool isMask) {
+const ScoreMatrixRow *Database::getScoreMatrix(char strand,
+						 bool isMask) const {
   if (strand == '+' || !args.isQueryStrandMatrix)
     return isMask ? scoreMatrix.caseSensitive : scoreMatrix.caseInsensitive;
   else
     return isMask ? scoreMatrixRevMasked : scoreMatrixRev;
 }
 
-const OneQualityScoreMatrix &getOneQualityMatrix(char strand, bool isMask) {
+const OneQualityScoreMatrix &
+Database::getOneQualityMatrix(char strand, bool isMask) const {
   if (strand == '+' || !args.isQueryStrandMatrix)
     return isMask ? oneQualityMatrixMasked : oneQualityMatrix;
   else
     return isMask ? oneQualityMatrixRevMasked : oneQualityMatrixRev;
 }
 
-const TwoQualityScoreMatrix &getTwoQualityMatrix(char strand, bool isMask) {
+const TwoQualityScoreMatrix &
+Database::getTwoQualityMatrix(char strand, bool isMask) const {
   if (strand == '+' || !args.isQueryStrandMatrix)
     return isMask ? twoQualityMatrixMasked : twoQualityMatrix;
   else
     return isMask ? twoQualityMatrixRevMasked : twoQualityMatrixRev;
 }
 
-const OneQualityExpMatrix &getOneQualityExpMatrix(char strand) {
+const OneQualityExpMatrix &Database::getOneQualityExpMatrix(char strand) const {
   if (strand == '+' || !args.isQueryStrandMatrix)
     return oneQualityExpMatrix;
   else
     return oneQualityExpMatrixRev;
 }
 
-const QualityPssmMaker &getQualityPssmMaker(char strand) {
+const QualityPssmMaker &Database::getQualityPssmMaker(char strand) const {
   if (strand == '+' || !args.isQueryStrandMatrix)
     return qualityPssmMaker;
   else
@@ -419,8 +588,8 @@ static const uchar *getQueryQual(size_t queryNum) {
   return q;
 }
 
-static const ScoreMatrixRow *getQueryPssm(const LastAligner &aligner,
-					  size_t queryNum) {
+const ScoreMatrixRow *Database::getQueryPssm(const LastAligner &aligner,
+					     size_t queryNum) const {
   if (args.isGreedy) return 0;
   if (args.inputFormat == sequenceFormat::pssm)
     return query.pssmReader() + query.padBeg(queryNum);
@@ -430,9 +599,7 @@ static const ScoreMatrixRow *getQueryPssm(const LastAligner &aligner,
   return reinterpret_cast<const ScoreMatrixRow *>(&qualityPssm[0]);
 }
 
-namespace Phase{ enum Enum{ gapless, gapped, final }; }
-
-static bool isMaskLowercase(Phase::Enum e) {
+bool Database::isMaskLowercase(Phase::Enum e) const {
   return (e < 1 && args.maskLowercase > 0) || args.maskLowercase > 2;
 }
 
@@ -447,17 +614,18 @@ struct Dispatcher{
   int d;  // the maximum score drop
   int z;
 
-  Dispatcher( Phase::Enum e, const LastAligner& aligner,
+  Dispatcher( const Database& db, Phase::Enum e, const LastAligner& aligner,
 	      size_t queryNum, char strand, const uchar* querySeq ) :
-      a( text.seqReader() ),
+      a( db.text.seqReader() ),
       b( querySeq ),
-      i( text.qualityReader() ),
+      i( db.text.qualityReader() ),
       j( getQueryQual(queryNum) ),
-      p( getQueryPssm(aligner, queryNum) ),
-      m( getScoreMatrix( strand, isMaskLowercase(e) ) ),
-      t( getTwoQualityMatrix( strand, isMaskLowercase(e) ) ),
-      d( (e == Phase::gapless) ? args.maxDropGapless :
-         (e == Phase::gapped ) ? args.maxDropGapped : args.maxDropFinal ),
+      p( db.getQueryPssm(aligner, queryNum) ),
+      m( db.getScoreMatrix( strand, db.isMaskLowercase(e) ) ),
+      t( db.getTwoQualityMatrix( strand, db.isMaskLowercase(e) ) ),
+      d( (e == Phase::gapless) ? db.args.maxDropGapless :
+         (e == Phase::gapped ) ? db.args.maxDropGapped :
+	 db.args.maxDropFinal ),
       z( t ? 2 : p ? 1 : 0 ){}
 
   int forwardGaplessScore( indexT x, indexT y ) const{
@@ -497,32 +665,97 @@ struct Dispatcher{
   }
 };
 
-static bool isCollatedAlignments() {
+bool Database::isCollatedAlignments() const {
   return args.outputFormat == 'b' || args.outputFormat == 'B' ||
-    args.cullingLimitForFinalAlignments;
-}
-
-static void printAndDelete(char *text) {
-  std::cout << text;
-  delete[] text;
+    args.cullingLimitForFinalAlignments || args.cullingOverlapFraction > 0 ||
+    args.maxAlignmentsPerQuery;
 }
 
-static void writeAlignment(LastAligner &aligner, const Alignment &aln,
-			   size_t queryNum, char strand, const uchar* querySeq,
-			   const AlignmentExtras &extras = AlignmentExtras()) {
+void Database::writeAlignment(LastAligner &aligner, const Alignment &aln,
+			      size_t queryNum, char strand, const uchar* querySeq,
+			      const AlignmentExtras &extras) {
+  if (!alignmentFilter.empty() &&
+      !alignmentFilter.isPass(aln, text, query, queryNum, querySeq,
+			      args.isTranslated(), alph, evaluer)) {
+    aligner.stats.add(ThreadStats::culledAlignments, 1);
+    return;
+  }
+  PhaseTimer timer(aligner.stats, ThreadStats::formatting);
   AlignmentText a = aln.write(text, query, queryNum, strand, querySeq,
 			      args.isTranslated(), alph, evaluer,
-			      args.outputFormat, extras);
-  if (isCollatedAlignments() || aligners.size() > 1)
+			      args.outputFormat, extras, aligner.textArena);
+  if (isCollatedAlignments() || aligners.size() > 1) {
     aligner.textAlns.push_back(a);
-  else
-    printAndDelete(a.text);
+  } else {
+    out->put(a.text);
+    aligner.textArena.clear();
+    aligner.stats.add(ThreadStats::outputAlignments, 1);
+  }
+}
+
+// Hint that we'll soon read this memory
+static void prefetchForRead( const void* p ){
+#ifdef __GNUC__
+  __builtin_prefetch( p, 0 );
+#else
+  (void)p;
+#endif
 }
 
+// The suffix-array matches of one query position, for one index
+struct SeedHits{
+  indexT queryPos;
+  const indexT* beg;
+  const indexT* end;
+};
+
+// How many seed lookups alignGapless does ahead of the extensions
+static const size_t seedLookupBatchSize = 32;
+
+// How many reference positions to prefetch for each seed
+static const size_t prefetchHitsPerSeed = 4;
+
+// Do a gapless extension from a match at query position i and
+// reference position j.  Return true if it makes a gapless alignment
+// that's good enough to keep.
+static bool extendGapless( const Dispatcher& dis, int minScore,
+			   indexT i, indexT j, SegmentPair& sp ){
+  int fs = dis.forwardGaplessScore( j, i );
+  int rs = dis.reverseGaplessScore( j, i );
+  int score = fs + rs;
+
+  // Tried checking the score after isOptimal & addEndpoint, but
+  // the number of extensions decreased by < 10%, and it was
+  // slower overall.
+  if( score < minScore ) return false;
+
+  indexT tEnd = dis.forwardGaplessEnd( j, i, fs );
+  indexT tBeg = dis.reverseGaplessEnd( j, i, rs );
+  indexT qBeg = i - (j - tBeg);
+  if( !dis.isOptimalGapless( tBeg, tEnd, qBeg ) ) return false;
+  sp = SegmentPair( tBeg, qBeg, tEnd - tBeg, score );
+  return true;
+}
+
+// A match for --sort-hits: its diagonal, and its rank in the usual
+// extension order
+struct SortableHit{
+  indexT diagonal;
+  indexT rank;
+  indexT queryPos;
+  indexT refPos;
+  bool operator<( const SortableHit& h ) const{
+    return diagonal != h.diagonal ? diagonal < h.diagonal : rank < h.rank;
+  }
+};
+
+// How many matches ahead to prefetch, when extending them in sorted order
+static const size_t sortedHitsPrefetchDistance = 8;
+
 // Find query matches to the suffix array, and do gapless extensions
-void alignGapless( LastAligner& aligner, SegmentPairPot& gaplessAlns,
-		   size_t queryNum, char strand, const uchar* querySeq ){
-  Dispatcher dis( Phase::gapless, aligner, queryNum, strand, querySeq );
+void Database::alignGapless( LastAligner& aligner, SegmentPairPot& gaplessAlns,
+			     size_t queryNum, char strand, const uchar* querySeq ){
+  Dispatcher dis( *this, Phase::gapless, aligner, queryNum, strand, querySeq );
   DiagonalTable dt;  // record already-covered positions on each diagonal
   countT matchCount = 0, gaplessExtensionCount = 0, gaplessAlignmentCount = 0;
 
@@ -536,17 +769,110 @@ void alignGapless( LastAligner& aligner, SegmentPairPot& gaplessAlns,
     minFinders[x].init( suffixArrays[x].getSeed(), dis.b, loopBeg, loopEnd );
   }
 
-  for( indexT i = loopBeg; i < loopEnd; i += args.queryStep ){
-    for( unsigned x = 0; x < numOfIndexes; ++x ){
-      const SubsetSuffixArray& sax = suffixArrays[x];
-      if( args.minimizerWindow > 1 &&
-	  !minFinders[x].isMinimizer( sax.getSeed(), dis.b, i, loopEnd,
-				      args.minimizerWindow ) ) continue;
-      const indexT* beg;
-      const indexT* end;
-      sax.match( beg, end, dis.b + i, dis.a,
-		 args.oneHitMultiplicity, args.minHitDepth, args.maxHitDepth );
-      matchCount += end - beg;
+  // Look up the matches of several query positions before extending
+  // any of them, and prefetch the reference letters at their first
+  // hits, so the cache misses of the extensions overlap.  The matches
+  // are extended in the same order as before.  With --sort-hits, a
+  // batch is a block of query positions.
+  size_t maxBatchPositions = args.sortedHitBlock ? args.sortedHitBlock : -1;
+  size_t maxBatchSeeds = args.sortedHitBlock ? -1 : seedLookupBatchSize;
+  std::vector<SeedHits> hits;
+  std::vector<SortableHit> sortedHits;
+  std::vector< std::pair<indexT, SegmentPair> > sortedAlns;
+
+  for( indexT batchBeg = loopBeg; batchBeg < loopEnd; /* noop */ ){
+    hits.clear();
+    indexT i = batchBeg;
+    for( size_t n = 0; i < loopEnd && n < maxBatchPositions &&
+	   hits.size() < maxBatchSeeds; i += args.queryStep, ++n ){
+      for( unsigned x = 0; x < numOfIndexes; ++x ){
+	const SubsetSuffixArray& sax = suffixArrays[x];
+	if( args.minimizerWindow > 1 &&
+	    !minFinders[x].isMinimizer( sax.getSeed(), dis.b, i, loopEnd,
+					args.minimizerWindow ) ) continue;
+	// Not done: re-using the previous position's suffix-array
+	// interval.  The seed restarts at phase 0 at each position, so
+	// with a cyclic seed adjacent positions share no search prefix.
+	// Even for span-1 seeds this would need suffix links, which
+	// lastdb doesn't make (child tables only go downwards).
+	SeedHits h;
+	h.queryPos = i;
+	sax.match( h.beg, h.end, dis.b + i, dis.a,
+		   args.oneHitMultiplicity, args.minHitDepth, args.maxHitDepth );
+	matchCount += h.end - h.beg;
+	size_t numPrefetch = std::min( size_t(h.end - h.beg),
+				       prefetchHitsPerSeed );
+	for( size_t k = 0; k < numPrefetch; ++k )
+	  prefetchForRead( dis.a + h.beg[k] );
+	hits.push_back(h);
+      }
+    }
+
+    // With --sort-hits, extend the matches in order of diagonal, which
+    // is roughly reference order, so the reference is read mostly
+    // sequentially.  Matches on one diagonal keep their usual order,
+    // and only they affect each other's coverage, so the same gapless
+    // alignments are found.  This isn't valid if the -n limit could
+    // stop the extensions at some query position.
+    bool isSorted = args.sortedHitBlock > 0;
+    for( size_t y = 0; y < hits.size() && isSorted; ++y )
+      if( indexT(hits[y].end - hits[y].beg) >
+	  args.maxGaplessAlignmentsPerQueryPosition ) isSorted = false;
+
+    if( isSorted ){
+      sortedHits.clear();
+      for( size_t y = 0; y < hits.size(); ++y ){
+	for( const indexT* beg = hits[y].beg; beg < hits[y].end; ++beg ){
+	  SortableHit h;
+	  h.queryPos = hits[y].queryPos;
+	  h.refPos = *beg;
+	  h.diagonal = h.refPos - h.queryPos;  // wrap-around is OK
+	  h.rank = sortedHits.size();
+	  sortedHits.push_back(h);
+	}
+      }
+      std::sort( sortedHits.begin(), sortedHits.end() );
+
+      sortedAlns.clear();
+      dt.startBlock( batchBeg );
+      for( size_t k = 0; k < sortedHits.size(); ++k ){
+	if( k + sortedHitsPrefetchDistance < sortedHits.size() )
+	  prefetchForRead( dis.a +
+			   sortedHits[k + sortedHitsPrefetchDistance].refPos );
+	const SortableHit& h = sortedHits[k];
+	if( dt.isCoveredInBlock( h.queryPos, h.refPos ) ) continue;
+	++gaplessExtensionCount;
+	SegmentPair sp;
+	if( !extendGapless( dis, minScoreGapless, h.queryPos, h.refPos, sp ) )
+	  continue;
+	dt.addEndpoint( sp.end2(), sp.end1() );
+	sortedAlns.push_back( std::make_pair( h.rank, sp ) );
+      }
+
+      // put the gapless alignments back in the usual order
+      std::sort( sortedAlns.begin(), sortedAlns.end(),
+		 []( const std::pair<indexT, SegmentPair>& a,
+		     const std::pair<indexT, SegmentPair>& b )
+		 { return a.first < b.first; } );
+
+      for( size_t k = 0; k < sortedAlns.size(); ++k ){
+	const SegmentPair& sp = sortedAlns[k].second;
+	if( args.outputType == 1 ){  // we just want gapless alignments
+	  Alignment aln;
+	  aln.fromSegmentPair(sp);
+	  writeAlignment( aligner, aln, queryNum, strand, querySeq );
+	}
+	else{
+	  gaplessAlns.add(sp);  // add the gapless alignment to the pot
+	}
+	++gaplessAlignmentCount;
+      }
+    }
+
+    for( size_t y = 0; y < hits.size() && !isSorted; ++y ){
+      indexT queryPos = hits[y].queryPos;
+      const indexT* beg = hits[y].beg;
+      const indexT* end = hits[y].end;
 
       // Tried: if we hit a delimiter when using contiguous seeds, then
       // increase "i" to the delimiter position.  This gave a speed-up
@@ -560,23 +886,11 @@ void alignGapless( LastAligner& aligner, SegmentPairPot& gaplessAlns,
 
 	indexT j = *beg;  // coordinate in the reference sequence
 
-	if( dt.isCovered( i, j ) ) continue;
+	if( dt.isCovered( queryPos, j ) ) continue;
 
-	int fs = dis.forwardGaplessScore( j, i );
-	int rs = dis.reverseGaplessScore( j, i );
-	int score = fs + rs;
 	++gaplessExtensionCount;
-
-	// Tried checking the score after isOptimal & addEndpoint, but
-	// the number of extensions decreased by < 10%, and it was
-	// slower overall.
-	if( score < minScoreGapless ) continue;
-
-	indexT tEnd = dis.forwardGaplessEnd( j, i, fs );
-	indexT tBeg = dis.reverseGaplessEnd( j, i, rs );
-	indexT qBeg = i - (j - tBeg);
-	if( !dis.isOptimalGapless( tBeg, tEnd, qBeg ) ) continue;
-	SegmentPair sp( tBeg, qBeg, tEnd - tBeg, score );
+	SegmentPair sp;
+	if( !extendGapless( dis, minScoreGapless, queryPos, j, sp ) ) continue;
 
 	if( args.outputType == 1 ){  // we just want gapless alignments
 	  Alignment aln;
@@ -592,30 +906,136 @@ void alignGapless( LastAligner& aligner, SegmentPairPot& gaplessAlns,
 	dt.addEndpoint( sp.end2(), sp.end1() );
       }
     }
+
+    batchBeg = i;
   }
 
   LOG2( "initial matches=" << matchCount );
   LOG2( "gapless extensions=" << gaplessExtensionCount );
   LOG2( "gapless alignments=" << gaplessAlignmentCount );
+  aligner.stats.add( ThreadStats::seedMatches, matchCount );
+  aligner.stats.add( ThreadStats::gaplessExtensions, gaplessExtensionCount );
+  aligner.stats.add( ThreadStats::gaplessAlignments, gaplessAlignmentCount );
 }
 
 // Shrink the SegmentPair to its longest run of identical matches.
 // This trims off possibly unreliable parts of the gapless alignment.
 // It may not be the best strategy for protein alignment with subset
 // seeds: there could be few or no identical matches...
-void shrinkToLongestIdenticalRun( SegmentPair& sp, const Dispatcher& dis ){
+void Database::shrinkToLongestIdenticalRun( SegmentPair& sp,
+					    const Dispatcher& dis ) const{
   sp.maxIdenticalRun( dis.a, dis.b, alph.numbersToUppercase );
   sp.score = dis.gaplessScore( sp.beg1(), sp.end1(), sp.beg2() );
 }
 
+// Can we skip gapped extensions that can't get into the top
+// --best-per-query alignments?  Not if we lack a simple maximum
+// score per letter pair, or if the best alignments found so far might
+// get discarded later.  With -j > 2, eraseSuboptimal can discard an
+// alignment that shares an endpoint with one found later, so the N-th
+// best score so far may go down: then only N = 1 is safe, because the
+// top-scoring alignment is never discarded.  But not with --filter,
+// because the best passing alignment might be discarded.
+bool Database::isPruningGapped( const Dispatcher& dis ) const{
+  size_t n = args.maxAlignmentsPerQuery;
+  bool isCulling = (args.cullingLimitForFinalAlignments ||
+		    args.cullingOverlapFraction > 0);
+  return n > 0 && dis.z == 0 && args.maskLowercase != 2 &&
+    (n == 1 || !isCulling) &&
+    (args.outputType < 3 || (n == 1 && alignmentFilter.empty()));
+}
+
+// An upper bound on the score of any gapped alignment that includes
+// the seed: each extra pair of aligned letters scores <= maxScore
+double Database::maxGappedScore( const SegmentPair& seed,
+				 size_t queryNum ) const{
+  indexT refNum = text.whichSequence( seed.beg1() );
+  indexT refBeg = text.seqBeg( refNum );
+  indexT refEnd = text.seqEnd( refNum );
+  indexT qryBeg = 0;
+  indexT qryEnd = query.padLen( queryNum );
+  if( !args.isTranslated() ){  // else the frames are concatenated
+    qryBeg = query.seqBeg(queryNum) - query.padBeg(queryNum);
+    qryEnd = query.seqEnd(queryNum) - query.padBeg(queryNum);
+  }
+  indexT left = std::min( seed.beg1() - refBeg, seed.beg2() - qryBeg );
+  indexT right = std::min( refEnd - seed.end1(), qryEnd - seed.end2() );
+  return seed.score + 1.0 * scoreMatrix.maxScore * (left + right);
+}
+
+// Record the score of a new gapped alignment among the best ones for
+// this query
+void Database::addBestScore( LastAligner& aligner, int score ) const{
+  std::vector<int>& v = aligner.bestScores;
+  v.push_back( score );
+  if( v.size() > args.maxAlignmentsPerQuery )
+    v.erase( std::min_element( v.begin(), v.end() ) );
+}
+
+// The score that a gapped alignment must exceed to get into the best
+// ones for this query, or INT_MIN if there aren't enough yet
+int Database::bestScoresMin( const LastAligner& aligner ) const{
+  const std::vector<int>& v = aligner.bestScores;
+  if( v.size() < args.maxAlignmentsPerQuery ) return INT_MIN;
+  return *std::min_element( v.begin(), v.end() );
+}
+
+// The maximum total size of the antidiagonal shapes that we save, for
+// one query strand.  Beyond this, alignFinish redoes the extensions.
+static const size_t maxSavedShapeSize = 1 << 24;
+
+// Save the newest gapped extensions, made from this seed, if there's
+// room for them
+static void saveExtensions( LastAligner& aligner, const SegmentPair& seed ){
+  SavedExtensions& x = aligner.newExtensions;
+  size_t size = x.extensions[0].shape.size() + x.extensions[1].shape.size();
+  if( size > maxSavedShapeSize - aligner.savedShapeSize ) return;
+  aligner.savedShapeSize += size;
+  x.seed = seed;
+  aligner.savedExtensions.push_back(x);
+}
+
+static bool lessSeed( const SegmentPair& x, const SegmentPair& y ){
+  if( x.beg1() != y.beg1() ) return x.beg1() < y.beg1();
+  if( x.beg2() != y.beg2() ) return x.beg2() < y.beg2();
+  return x.size < y.size;
+}
+
+static bool lessSavedSeed( const SavedExtensions& x,
+			   const SavedExtensions& y ){
+  return lessSeed( x.seed, y.seed );
+}
+
+// Get the saved gapped extensions made from this seed, or null if
+// there aren't any.  The saved extensions must be sorted by seed.
+static const GappedExtension* findExtensions( const LastAligner& aligner,
+					      const SegmentPair& seed ){
+  const std::vector<SavedExtensions>& v = aligner.savedExtensions;
+  SavedExtensions key;
+  key.seed = seed;
+  std::vector<SavedExtensions>::const_iterator i =
+    std::lower_bound( v.begin(), v.end(), key, lessSavedSeed );
+  if( i == v.end() || lessSeed( seed, i->seed ) ) return 0;
+  return i->extensions;
+}
+
 // Do gapped extensions of the gapless alignments
-void alignGapped( LastAligner& aligner,
-		  AlignmentPot& gappedAlns, SegmentPairPot& gaplessAlns,
-                  size_t queryNum, char strand, const uchar* querySeq,
-		  Phase::Enum phase ){
-  Dispatcher dis( phase, aligner, queryNum, strand, querySeq );
+void Database::alignGapped( LastAligner& aligner,
+			    AlignmentPot& gappedAlns, SegmentPairPot& gaplessAlns,
+			    size_t queryNum, char strand, const uchar* querySeq,
+			    Phase::Enum phase ){
+  Dispatcher dis( *this, phase, aligner, queryNum, strand, querySeq );
   indexT frameSize = args.isFrameshift() ? (query.padLen(queryNum) / 3) : 0;
   countT gappedExtensionCount = 0, gappedAlignmentCount = 0;
+  countT prunedExtensionCount = 0;
+  bool isPruning = isPruningGapped( dis );
+
+  // With -j > 3, alignFinish re-does the final gapped extensions, to
+  // get the match probabilities.  So save them, and it can re-use the
+  // X-drop dynamic programming region instead.
+  bool isSavingExtensions = (phase == Phase::final && args.outputType > 3);
+  aligner.savedExtensions.clear();
+  aligner.savedShapeSize = 0;
 
   // Redo the gapless extensions, using gapped score parameters.
   // Without this, if we self-compare a huge sequence, we risk getting
@@ -642,24 +1062,52 @@ void alignGapped( LastAligner& aligner,
 
   LOG2( "redone gapless alignments=" << gaplessAlns.size() );
 
+  bool isChaining = args.maxChainDistance > 0;
+  countT chainCoveredCount = 0;
+  if( isChaining ){
+    chainSegmentPairs( gaplessAlns.items, aligner.chainIds, gapCosts,
+		       args.maxChainDistance );
+    aligner.chainCoverage.clear( gaplessAlns.size() );
+  }
+
   for( size_t i = 0; i < gaplessAlns.size(); ++i ){
     SegmentPair& sp = gaplessAlns.get(i);
 
     if( SegmentPairPot::isMarked(sp) ) continue;
 
+    size_t chainId = 0;
+    if( isChaining ){
+      chainId = aligner.chainIds[ &sp - &gaplessAlns.items[0] ];
+      if( aligner.chainCoverage.isCovered( chainId, sp ) ){
+	++chainCoveredCount;
+	continue;
+      }
+    }
+
     Alignment aln;
     AlignmentExtras extras;  // not used
     aln.seed = sp;
 
     shrinkToLongestIdenticalRun( aln.seed, dis );
 
+    if( isPruning && maxGappedScore( aln.seed, queryNum ) <
+	bestScoresMin( aligner ) ){
+      ++prunedExtensionCount;
+      continue;
+    }
+
     // do gapped extension from each end of the seed:
     aln.makeXdrop( aligner.centroid, aligner.greedyAligner, args.isGreedy,
 		   dis.a, dis.b, args.globality, dis.m, scoreMatrix.maxScore,
 		   gapCosts, dis.d, args.frameshiftCost, frameSize,
-		   dis.p, dis.t, dis.i, dis.j, alph, extras );
+		   dis.p, dis.t, dis.i, dis.j, alph, extras, 0, 0,
+		   isSavingExtensions ? aligner.newExtensions.extensions : 0 );
     ++gappedExtensionCount;
 
+    if( isChaining )
+      aligner.chainCoverage.add( chainId, aln.beg1(), aln.end1(),
+				 aln.beg2(), aln.end2() );
+
     if( aln.score < args.minScoreGapped ) continue;
 
     if( !aln.isOptimal( dis.a, dis.b, args.globality, dis.m, dis.d, gapCosts,
@@ -673,22 +1121,36 @@ void alignGapped( LastAligner& aligner,
     gaplessAlns.markAllOverlaps( aln.blocks );
     gaplessAlns.markTandemRepeats( aln.seed, args.maxRepeatDistance );
 
-    if( phase == Phase::final ) gappedAlns.add(aln);
+    if( phase == Phase::final ){
+      gappedAlns.add(aln);
+      if( isSavingExtensions ) saveExtensions( aligner, aln.seed );
+      if( isPruning &&
+	  (alignmentFilter.empty() ||
+	   alignmentFilter.isPass( aln, text, query, queryNum, querySeq,
+				   args.isTranslated(), alph, evaluer )) )
+	addBestScore( aligner, aln.score );
+    }
     else SegmentPairPot::markAsGood(sp);
 
     ++gappedAlignmentCount;
   }
 
+  if( isChaining )
+    LOG2( "chain-covered gapless alignments=" << chainCoveredCount );
   LOG2( "gapped extensions=" << gappedExtensionCount );
+  if( isPruning ) LOG2( "pruned gapped extensions=" << prunedExtensionCount );
   LOG2( "gapped alignments=" << gappedAlignmentCount );
+  aligner.stats.add( ThreadStats::gappedExtensions, gappedExtensionCount );
+  if( phase == Phase::final )
+    aligner.stats.add( ThreadStats::gappedAlignments, gappedAlignmentCount );
 }
 
 // Print the gapped alignments, after optionally calculating match
 // probabilities and re-aligning using the gamma-centroid algorithm
-void alignFinish( LastAligner& aligner, const AlignmentPot& gappedAlns,
-		  size_t queryNum, char strand, const uchar* querySeq ){
+void Database::alignFinish( LastAligner& aligner, const AlignmentPot& gappedAlns,
+			    size_t queryNum, char strand, const uchar* querySeq ){
   Centroid& centroid = aligner.centroid;
-  Dispatcher dis( Phase::final, aligner, queryNum, strand, querySeq );
+  Dispatcher dis( *this, Phase::final, aligner, queryNum, strand, querySeq );
   indexT frameSize = args.isFrameshift() ? (query.padLen(queryNum) / 3) : 0;
 
   if( args.outputType > 3 ){
@@ -700,6 +1162,8 @@ void alignFinish( LastAligner& aligner, const AlignmentPot& gappedAlns,
       centroid.setScoreMatrix( dis.m, args.temperature );
     }
     centroid.setOutputType( args.outputType );
+    std::sort( aligner.savedExtensions.begin(),
+	       aligner.savedExtensions.end(), lessSavedSeed );
   }
 
   for( size_t i = 0; i < gappedAlns.size(); ++i ){
@@ -716,18 +1180,20 @@ void alignFinish( LastAligner& aligner, const AlignmentPot& gappedAlns,
 			 dis.m, scoreMatrix.maxScore, gapCosts, dis.d,
                          args.frameshiftCost, frameSize,
 			 dis.p, dis.t, dis.i, dis.j, alph, extras,
-			 args.gamma, args.outputType );
+			 args.gamma, args.outputType, 0,
+			 findExtensions( aligner, aln.seed ) );
       assert( aln.score != -INF );
       writeAlignment( aligner, probAln, queryNum, strand, querySeq, extras );
     }
   }
 }
 
-static void eraseWeakAlignments(LastAligner &aligner, AlignmentPot &gappedAlns,
-				size_t queryNum, char strand,
-				const uchar *querySeq) {
+void Database::eraseWeakAlignments(LastAligner &aligner,
+				   AlignmentPot &gappedAlns,
+				   size_t queryNum, char strand,
+				   const uchar *querySeq) {
   indexT frameSize = args.isFrameshift() ? (query.padLen(queryNum) / 3) : 0;
-  Dispatcher dis(Phase::gapless, aligner, queryNum, strand, querySeq);
+  Dispatcher dis(*this, Phase::gapless, aligner, queryNum, strand, querySeq);
   for (size_t i = 0; i < gappedAlns.size(); ++i) {
     Alignment &a = gappedAlns.items[i];
     if (!a.hasGoodSegment(dis.a, dis.b, args.minScoreGapped, dis.m, gapCosts,
@@ -747,8 +1213,8 @@ static bool lessForCulling(const AlignmentText &x, const AlignmentText &y) {
 
 // Remove any alignment whose query range lies in LIMIT or more other
 // alignments with higher score (and on the same strand):
-static void cullFinalAlignments(std::vector<AlignmentText> &textAlns,
-				size_t start) {
+void Database::cullFinalAlignments(std::vector<AlignmentText> &textAlns,
+				   size_t start) {
   if (!args.cullingLimitForFinalAlignments) return;
   sort(textAlns.begin() + start, textAlns.end(), lessForCulling);
   std::vector<size_t> stash;  // alignments that might dominate subsequent ones
@@ -766,9 +1232,7 @@ static void cullFinalAlignments(std::vector<AlignmentText> &textAlns,
       if (y.queryEnd >= x.queryEnd && y.score > x.score) ++numOfDominators;
     }
     stash.resize(a);
-    if (numOfDominators >= args.cullingLimitForFinalAlignments) {
-      delete[] x.text;
-    } else {
+    if (numOfDominators < args.cullingLimitForFinalAlignments) {
       stash.push_back(i);
       textAlns[i++] = x;  // keep this alignment
     }
@@ -776,20 +1240,130 @@ static void cullFinalAlignments(std::vector<AlignmentText> &textAlns,
   textAlns.resize(i);
 }
 
-static void printAndClear(std::vector<AlignmentText> &textAlns) {
+// A segment tree, for getting the maximum of any range of values, in
+// O(log n) time
+class MaxTree {
+public:
+  void init(size_t size) { n = size; t.assign(2 * n, 0); }
+
+  void raise(size_t i, size_t x) {  // v[i] = max(v[i], x)
+    for (i += n; i > 0 && t[i] < x; i /= 2) t[i] = x;
+  }
+
+  size_t max(size_t beg, size_t end) const {  // max of v[beg, end)
+    size_t m = 0;
+    for (beg += n, end += n; beg < end; beg /= 2, end /= 2) {
+      if (beg % 2) m = std::max(m, t[beg++]);
+      if (end % 2) m = std::max(m, t[--end]);
+    }
+    return m;
+  }
+
+private:
+  size_t n;
+  std::vector<size_t> t;
+};
+
+// Remove any alignment that overlaps an alignment with higher score
+// (and on the same strand) by at least the given fraction of its
+// query range.  The alignments are visited in order of decreasing
+// score.  The kept ones are recorded by query start coordinate, with
+// their maximum end coordinate and length, so each check is O(log n).
+void
+Database::cullOverlappingAlignments(std::vector<AlignmentText> &textAlns,
+				    size_t start) {
+  double fraction = args.cullingOverlapFraction;
+  if (fraction <= 0) return;
+  sort(textAlns.begin() + start, textAlns.end(), lessForCulling);
+  std::vector<size_t> begs, order;
+  MaxTree maxEnds, maxLens;
+  for (size_t b = start; b < textAlns.size(); ) {
+    size_t e = b + 1;  // [b, e) = alignments on one query strand
+    while (e < textAlns.size() &&
+	   textAlns[e].strandNum == textAlns[b].strandNum) ++e;
+
+    begs.clear();
+    order.clear();
+    for (size_t i = b; i < e; ++i) {
+      if (begs.empty() || begs.back() < textAlns[i].queryBeg)
+	begs.push_back(textAlns[i].queryBeg);
+      order.push_back(i);
+    }
+    sort(order.begin(), order.end(),
+	 [&](size_t i, size_t j) { return textAlns[i] < textAlns[j]; });
+    maxEnds.init(begs.size());
+    maxLens.init(begs.size());
+
+    for (size_t k = 0; k < order.size(); ++k) {
+      AlignmentText &x = textAlns[order[k]];
+      size_t xLen = x.queryEnd - x.queryBeg;
+      size_t need = std::max(std::ceil(fraction * xLen), 1.0);
+      // kept alignments starting at or before x, with enough overlap:
+      size_t p = std::lower_bound(begs.begin(), begs.end(), x.queryBeg)
+	- begs.begin();
+      bool isCovered = (maxEnds.max(0, p + 1) >= x.queryBeg + need);
+      // kept alignments starting inside x, with enough overlap:
+      if (!isCovered && need <= xLen) {
+	size_t q = std::upper_bound(begs.begin(), begs.end(),
+				    x.queryEnd - need) - begs.begin();
+	isCovered = (p + 1 < q && maxLens.max(p + 1, q) >= need);
+      }
+      if (isCovered) {
+	x.text = 0;
+      } else {
+	maxEnds.raise(p, x.queryEnd);
+	maxLens.raise(p, xLen);
+      }
+    }
+
+    b = e;
+  }
+
+  size_t i = start;
+  for (size_t j = start; j < textAlns.size(); ++j)
+    if (textAlns[j].text) textAlns[i++] = textAlns[j];
+  textAlns.resize(i);
+}
+
+// Keep just the --best-per-query alignments of each query
+void Database::keepBestPerQuery(std::vector<AlignmentText> &textAlns,
+				size_t start) {
+  size_t n = args.maxAlignmentsPerQuery;
+  if (!n) return;
+  sort(textAlns.begin() + start, textAlns.end());
+  size_t i = start;  // number of kept alignments so far
+  size_t numInQuery = 0;
+  for (size_t j = start; j < textAlns.size(); ++j) {
+    AlignmentText &x = textAlns[j];
+    if (j > start && x.queryNum() != textAlns[j - 1].queryNum())
+      numInQuery = 0;
+    if (numInQuery++ < n) textAlns[i++] = x;
+  }
+  textAlns.resize(i);
+}
+
+void Database::printAndClear(std::vector<AlignmentText> &textAlns) {
   for (size_t i = 0; i < textAlns.size(); ++i)
-    printAndDelete(textAlns[i].text);
+    out->putShared(textAlns[i].text);
   textAlns.clear();
 }
 
-static void printAndClearAll() {
-  for (size_t i = 0; i < aligners.size(); ++i)
-    printAndClear(aligners[i].textAlns);
+// Note that this query is finished, and write the alignments of all
+// finished queries before the first unfinished one
+void Database::printFinishedQueries(size_t queryNum) {
+#ifdef HAS_CXX_THREADS
+  std::lock_guard<std::mutex> lock(outputMutex);
+#endif
+  isQueryFinished[queryNum] = true;
+  while (numOfPrintedQueries < queryAlns.size() &&
+	 isQueryFinished[numOfPrintedQueries])
+    printAndClear(queryAlns[numOfPrintedQueries++]);
+  writeProgressIfWanted();
 }
 
-void makeQualityPssm( LastAligner& aligner,
-		      size_t queryNum, char strand, const uchar* querySeq,
-		      bool isMask ){
+void Database::makeQualityPssm( LastAligner& aligner,
+				size_t queryNum, char strand, const uchar* querySeq,
+				bool isMask ){
   if( !isQuality( args.inputFormat ) || isQuality( referenceFormat ) ) return;
   if( args.isTranslated() || args.isGreedy ) return;
 
@@ -813,8 +1387,8 @@ void makeQualityPssm( LastAligner& aligner,
 }
 
 // Scan one query sequence against one database volume
-void scan( LastAligner& aligner,
-	   size_t queryNum, char strand, const uchar* querySeq ){
+void Database::scan( LastAligner& aligner,
+		     size_t queryNum, char strand, const uchar* querySeq ){
   if( args.outputType == 0 ){  // we just want match counts
     countMatches( queryNum, querySeq );
     return;
@@ -823,22 +1397,30 @@ void scan( LastAligner& aligner,
   bool isMask = (args.maskLowercase > 0);
   makeQualityPssm( aligner, queryNum, strand, querySeq, isMask );
 
-  SegmentPairPot gaplessAlns;
-  alignGapless( aligner, gaplessAlns, queryNum, strand, querySeq );
+  SegmentPairPot &gaplessAlns = aligner.gaplessAlns;
+  gaplessAlns.items.clear();
+  gaplessAlns.iters.clear();
+  {
+    PhaseTimer timer( aligner.stats, ThreadStats::gapless );
+    alignGapless( aligner, gaplessAlns, queryNum, strand, querySeq );
+  }
   if( args.outputType == 1 ) return;  // we just want gapless alignments
   if( gaplessAlns.size() == 0 ) return;
 
   if( args.maskLowercase == 1 || args.maskLowercase == 2 )
     makeQualityPssm( aligner, queryNum, strand, querySeq, false );
 
-  AlignmentPot gappedAlns;
+  AlignmentPot &gappedAlns = aligner.gappedAlns;
+  gappedAlns.items.clear();
 
   if( args.maxDropFinal != args.maxDropGapped ){
+    PhaseTimer timer( aligner.stats, ThreadStats::gapped );
     alignGapped( aligner, gappedAlns, gaplessAlns,
 		 queryNum, strand, querySeq, Phase::gapped );
     erase_if( gaplessAlns.items, SegmentPairPot::isNotMarkedAsGood );
   }
 
+  PhaseTimer timer( aligner.stats, ThreadStats::final );
   alignGapped( aligner, gappedAlns, gaplessAlns,
 	       queryNum, strand, querySeq, Phase::final );
   if( gappedAlns.size() == 0 ) return;
@@ -861,13 +1443,13 @@ void scan( LastAligner& aligner,
   alignFinish( aligner, gappedAlns, queryNum, strand, querySeq );
 }
 
-static void tantanMaskOneQuery(size_t queryNum, uchar *querySeq) {
+void Database::tantanMaskOneQuery(size_t queryNum, uchar *querySeq) {
   size_t beg = query.seqBeg(queryNum) - query.padBeg(queryNum);
   size_t end = query.seqEnd(queryNum) - query.padBeg(queryNum);
   tantanMasker.mask(querySeq + beg, querySeq + end, alph.numbersToLowercase);
 }
 
-static void tantanMaskTranslatedQuery(size_t queryNum, uchar *querySeq) {
+void Database::tantanMaskTranslatedQuery(size_t queryNum, uchar *querySeq) {
   size_t frameSize = query.padLen(queryNum) / 3;
   size_t dnaBeg = query.seqBeg(queryNum) - query.padBeg(queryNum);
   size_t dnaLen = query.seqLen(queryNum);
@@ -883,7 +1465,8 @@ static void tantanMaskTranslatedQuery(size_t queryNum, uchar *querySeq) {
 
 // Scan one query sequence strand against one database volume,
 // after optionally translating and/or masking the query
-void translateAndScan( LastAligner& aligner, size_t queryNum, char strand ){
+void Database::translateAndScan( LastAligner& aligner,
+				 size_t queryNum, char strand ){
   const uchar* querySeq = query.seqReader() + query.padBeg(queryNum);
   std::vector<uchar> modifiedQuery;
   size_t size = query.padLen(queryNum);
@@ -905,10 +1488,14 @@ void translateAndScan( LastAligner& aligner, size_t queryNum, char strand ){
 
   size_t oldNumOfAlns = aligner.textAlns.size();
   scan( aligner, queryNum, strand, querySeq );
+  size_t numOfAlns = aligner.textAlns.size();
   cullFinalAlignments( aligner.textAlns, oldNumOfAlns );
+  cullOverlappingAlignments( aligner.textAlns, oldNumOfAlns );
+  aligner.stats.add( ThreadStats::culledAlignments,
+		     numOfAlns - aligner.textAlns.size() );
 }
 
-static void reverseComplementPssm( size_t queryNum ){
+void Database::reverseComplementPssm( size_t queryNum ){
   ScoreMatrixRow* beg = query.pssmWriter() + query.seqBeg(queryNum);
   ScoreMatrixRow* end = query.pssmWriter() + query.seqEnd(queryNum);
 
@@ -922,7 +1509,7 @@ static void reverseComplementPssm( size_t queryNum ){
   }
 }
 
-static void reverseComplementQuery( size_t queryNum ){
+void Database::reverseComplementQuery( size_t queryNum ){
   size_t b = query.seqBeg(queryNum);
   size_t e = query.seqEnd(queryNum);
   queryAlph.rc( query.seqWriter() + b, query.seqWriter() + e );
@@ -934,65 +1521,80 @@ static void reverseComplementQuery( size_t queryNum ){
   }
 }
 
-static void alignOneQuery(LastAligner &aligner,
-			  size_t queryNum, bool isFirstVolume) {
-  if (args.strand == 2 && !isFirstVolume)
-    reverseComplementQuery(queryNum);
+// The query may have been left reverse-complemented by a previous
+// volume or database
+void Database::alignOneQuery(LastAligner &aligner,
+			     size_t queryNum, bool isReversed) {
+  aligner.bestScores.clear();
 
-  if (args.strand != 0)
+  if (args.strand != 0) {
+    if (isReversed) reverseComplementQuery(queryNum);
     translateAndScan(aligner, queryNum, '+');
+    isReversed = false;
+  }
 
-  if (args.strand == 2 || (args.strand == 0 && isFirstVolume))
-    reverseComplementQuery(queryNum);
-
-  if (args.strand != 1)
+  if (args.strand != 1) {
+    if (!isReversed) reverseComplementQuery(queryNum);
     translateAndScan(aligner, queryNum, '-');
+  }
 }
 
-static void alignSomeQueries(size_t chunkNum,
-			     unsigned volume, unsigned volumeCount) {
-  size_t numOfChunks = aligners.size();
-  LastAligner &aligner = aligners[chunkNum];
+// The aligner's textAlns are empty before and after this
+void Database::alignQueryToVolume(LastAligner &aligner, size_t queryNum,
+				  unsigned volume, unsigned volumeCount) {
   std::vector<AlignmentText> &textAlns = aligner.textAlns;
-  size_t beg = firstSequenceInChunk(query, numOfChunks, chunkNum);
-  size_t end = firstSequenceInChunk(query, numOfChunks, chunkNum + 1);
   bool isMultiVolume = (volumeCount > 1);
-  bool isFirstVolume = (volume == 0);
   bool isFinalVolume = (volume + 1 == volumeCount);
-  bool isFirstThread = (chunkNum == 0);
   bool isSort = isCollatedAlignments();
-  bool isSortPerQuery = (isSort && !isMultiVolume);
-  bool isPrintPerQuery = (isFirstThread && !(isSort && isMultiVolume));
-  for (size_t i = beg; i < end; ++i) {
-    size_t oldNumOfAlns = textAlns.size();
-    alignOneQuery(aligner, i, isFirstVolume);
-    if (isSortPerQuery) sort(textAlns.begin() + oldNumOfAlns, textAlns.end());
-    if (isPrintPerQuery) printAndClear(textAlns);
-  }
-  if (isFinalVolume && isMultiVolume) {
-    cullFinalAlignments(textAlns, 0);
-    if (isSort) sort(textAlns.begin(), textAlns.end());
-    if (isFirstThread) printAndClear(textAlns);
+
+  ThreadStats &stats = aligner.stats;
+
+  alignOneQuery(aligner, queryNum, isQueryReversed);
+  stats.setCount(ThreadStats::dpCells,
+		 aligner.centroid.aligner().totalCellsAndPads());
+  size_t numOfAlns = textAlns.size();
+  if (!isMultiVolume) keepBestPerQuery(textAlns, 0);
+  stats.add(ThreadStats::culledAlignments, numOfAlns - textAlns.size());
+
+  std::vector<AlignmentText> &alns = queryAlns[queryNum];
+  alns.insert(alns.end(), textAlns.begin(), textAlns.end());
+  textAlns.clear();
+
+  if (isSort && isMultiVolume && !isFinalVolume) return;
+  if (isMultiVolume && isFinalVolume) {
+    numOfAlns = alns.size();
+    cullFinalAlignments(alns, 0);
+    cullOverlappingAlignments(alns, 0);
+    keepBestPerQuery(alns, 0);
+    stats.add(ThreadStats::culledAlignments, numOfAlns - alns.size());
   }
+  if (isSort) sort(alns.begin(), alns.end());
+  stats.add(ThreadStats::outputAlignments, alns.size());
+  PhaseTimer timer(stats, ThreadStats::ioWait);
+  printFinishedQueries(queryNum);
 }
 
-static void scanOneVolume(unsigned volume, unsigned volumeCount) {
-#ifdef HAS_CXX_THREADS
-  size_t numOfChunks = aligners.size();
-  std::vector<std::thread> threads(numOfChunks - 1);
-  for (size_t i = 1; i < numOfChunks; ++i)
-    threads[i - 1] = std::thread(alignSomeQueries, i, volume, volumeCount);
-  // Exceptions from threads are not handled nicely, but I don't
-  // think it matters much.
-#endif
-  alignSomeQueries(0, volume, volumeCount);
-#ifdef HAS_CXX_THREADS
-  for (size_t i = 1; i < numOfChunks; ++i)
-    threads[i - 1].join();
-#endif
+// Each thread starts with a chunk of queries with roughly equal
+// numbers of letters, and steals queries from other threads when it
+// runs out.  The output is in query order regardless.
+void Database::scanOneVolume(unsigned volume, unsigned volumeCount) {
+  size_t numOfQueries = query.finishedSequences();
+  queryAlns.resize(numOfQueries);
+  isQueryFinished.assign(numOfQueries, false);
+  numOfPrintedQueries = 0;
+
+  size_t numOfChunks = threadPool.size();
+  std::vector<size_t> firstQueries(numOfChunks + 1);
+  for (size_t i = 0; i <= numOfChunks; ++i)
+    firstQueries[i] = firstSequenceInChunk(query, numOfChunks, i);
+
+  threadPool.run(firstQueries, [&](size_t threadNum, size_t queryNum) {
+    alignQueryToVolume(aligners[threadNum], queryNum, volume, volumeCount);
+  });
+  isQueryReversed = (args.strand != 1);
 }
 
-void readIndex( const std::string& baseName, indexT seqCount ) {
+void Database::readIndex( const std::string& baseName, indexT seqCount ) {
   LOG( "reading " << baseName << "..." );
   text.fromFiles( baseName, seqCount, isFastq( referenceFormat ) );
   for( unsigned x = 0; x < numOfIndexes; ++x ){
@@ -1006,7 +1608,7 @@ void readIndex( const std::string& baseName, indexT seqCount ) {
 }
 
 // Read one database volume
-void readVolume( unsigned volumeNumber ){
+void Database::readVolume( unsigned volumeNumber ){
   std::string baseName = args.lastdbName + stringify(volumeNumber);
   indexT seqCount = indexT(-1);
   indexT seqLen = indexT(-1);
@@ -1016,7 +1618,7 @@ void readVolume( unsigned volumeNumber ){
 }
 
 // Scan one batch of query sequences against all database volumes
-void scanAllVolumes( unsigned volumes, std::ostream& out ){
+void Database::scanAllVolumes( unsigned volumes ){
   if( args.outputType == 0 ){
     matchCounts.clear();
     matchCounts.resize( query.finishedSequences() );
@@ -1028,14 +1630,24 @@ void scanAllVolumes( unsigned volumes, std::ostream& out ){
   for( unsigned i = 0; i < volumes; ++i ){
     if( text.unfinishedSize() == 0 || isMultiVolume ) readVolume( i );
     scanOneVolume( i, volumes );
-    if( !isCollatedAlignments() ) printAndClearAll();
   }
 
-  if( args.outputType == 0 ) writeCounts( out );
-  printAndClearAll();
+  if( args.outputType == 0 ){
+    std::ostringstream counts;
+    writeCounts( counts );
+    out->put( counts.str() );
+  }
+}
+
+// Scan one batch of query sequences, and write the results
+void Database::scanBatch( countT queryBatchNum ){
+  // this enables downstream parsers to read one batch at a time:
+  out->put( "# batch " + stringify( queryBatchNum ) + "\n" );
+  scanAllVolumes( volumes );
 }
 
-void writeHeader( countT refSequences, countT refLetters, std::ostream& out ){
+void Database::writeHeader( countT refSequences, countT refLetters,
+			    std::ostream& out ){
   out << "# LAST version " <<
 #include "version.hh"
       << "\n";
@@ -1083,48 +1695,66 @@ void writeHeader( countT refSequences, countT refLetters, std::ostream& out ){
 }
 
 // Read the next sequence, adding it to the MultiSequence
-std::istream& appendFromFasta( std::istream& in ){
+std::istream& Database::appendFromFasta( MultiSequence& batch,
+					 std::istream& in ) const{
   indexT maxSeqLen = args.batchSize;
   if( maxSeqLen < args.batchSize ) maxSeqLen = indexT(-1);
-  if( query.finishedSequences() == 0 ) maxSeqLen = indexT(-1);
+  if( batch.finishedSequences() == 0 ) maxSeqLen = indexT(-1);
 
-  size_t oldSize = query.unfinishedSize();
+  size_t oldSize = batch.unfinishedSize();
 
   /**/ if( args.inputFormat == sequenceFormat::fasta )
-    query.appendFromFasta( in, maxSeqLen );
+    batch.appendFromFasta( in, maxSeqLen );
   else if( args.inputFormat == sequenceFormat::prb )
-    query.appendFromPrb( in, maxSeqLen, queryAlph.size, queryAlph.decode );
+    batch.appendFromPrb( in, maxSeqLen, queryAlph.size, queryAlph.decode );
   else if( args.inputFormat == sequenceFormat::pssm )
-    query.appendFromPssm( in, maxSeqLen, queryAlph.encode,
+    batch.appendFromPssm( in, maxSeqLen, queryAlph.encode,
                           args.maskLowercase > 1 );
   else
-    query.appendFromFastq( in, maxSeqLen );
+    batch.appendFromFastq( in, maxSeqLen );
 
-  if( !query.isFinished() && query.finishedSequences() == 0 )
+  if( !batch.isFinished() && batch.finishedSequences() == 0 )
     ERR( "encountered a sequence that's too long" );
 
   // encode the newly-read sequence
-  uchar* seq = query.seqWriter();
-  size_t newSize = query.unfinishedSize();
+  uchar* seq = batch.seqWriter();
+  size_t newSize = batch.unfinishedSize();
   queryAlph.tr( seq + oldSize, seq + newSize, args.isKeepLowercase );
 
   if( isPhred( args.inputFormat ) )  // assumes one quality code per letter:
-    checkQualityCodes( query.qualityReader() + oldSize,
-                       query.qualityReader() + newSize,
+    checkQualityCodes( batch.qualityReader() + oldSize,
+                       batch.qualityReader() + newSize,
                        qualityOffset( args.inputFormat ) );
 
   return in;
 }
 
-void lastal( int argc, char** argv ){
+// Get this database's options: from the command line, then, if this
+// isn't the main database, from its own options
+void Database::argsFromCommandLine( int argc, char** argv,
+				    const std::string& name,
+				    const std::string& options ){
   args.fromArgs( argc, argv );
+  if( name.empty() ) return;
+  args.fromLine( std::string(argv[0]) + " " + options, true );
+  args.programName = argv[0];
+  args.lastdbName = name;
+}
+
+// Set up this database, from the options and the lastdb files.
+// "spec" is empty for the main database, else "LASTDB OUTFILE [OPTIONS]"
+void Database::setUp( int argc, char** argv, const std::string& spec ){
+  std::istringstream iss( spec );
+  std::string name, outFileName, options;
+  iss >> name >> outFileName;
+  getline( iss, options );
+  bool isMainDatabase = name.empty();
+
+  argsFromCommandLine( argc, argv, name, options );
   args.resetCumulativeOptions();  // because we will do fromArgs again
 
-  unsigned volumes = unsigned(-1);
   indexT refMinimizerWindow = 1;  // assume this value, if not specified
   indexT minSeedLimit = 0;
-  countT refSequences = -1;
-  countT refLetters = -1;
   bool isKeepRefLowercase = true;
   int refTantanSetting = 0;
   readOuterPrj( args.lastdbName + ".prj", volumes,
@@ -1134,7 +1764,8 @@ void lastal( int argc, char** argv ){
   bool isDna = (alph.letters == alph.dna);
   bool isProtein = alph.isProtein();
 
-  args.fromArgs( argc, argv );  // command line overrides prj file
+  // command line overrides prj file
+  argsFromCommandLine( argc, argv, name, options );
 
   std::string matrixName = args.matrixName( isProtein );
   std::string matrixFile;
@@ -1142,7 +1773,8 @@ void lastal( int argc, char** argv ){
     matrixFile = ScoreMatrix::stringFromName( matrixName );
     args.resetCumulativeOptions();
     args.fromString( matrixFile );  // read options from the matrix file
-    args.fromArgs( argc, argv );  // command line overrides matrix file
+    // command line overrides matrix file
+    argsFromCommandLine( argc, argv, name, options );
   }
 
   if( minSeedLimit > 1 ){
@@ -1156,8 +1788,11 @@ void lastal( int argc, char** argv ){
       ERR( "can't use option -l > 1: need to re-run lastdb with i <= 1" );
   }
 
-  aligners.resize( decideNumberOfThreads( args.numOfThreads,
-					  args.programName, args.verbosity ) );
+  if( aligners.empty() ){  // the main database decides the number of threads
+    aligners.resize( decideNumberOfThreads( args.numOfThreads,
+					    args.programName, args.verbosity ) );
+    threadPool.resize( aligners.size() );
+  }
   bool isMultiVolume = (volumes+1 > 0 && volumes > 1);
   args.setDefaultsFromAlphabet( isDna, isProtein, refLetters,
 				isKeepRefLowercase, refTantanSetting,
@@ -1179,11 +1814,11 @@ void lastal( int argc, char** argv ){
     else
       geneticCode.fromFile( args.geneticCodeFile );
     geneticCode.codeTableSet( alph, queryAlph );
-    query.initForAppending(3);
+    if( isMainDatabase ) query.initForAppending(3);
   }
   else{
     queryAlph = alph;
-    query.initForAppending(1);
+    if( isMainDatabase ) query.initForAppending(1);
   }
 
   if( args.outputType > 0 ) calculateScoreStatistics( matrixName, refLetters );
@@ -1193,44 +1828,371 @@ void lastal( int argc, char** argv ){
   if( !isMultiVolume ) args.minScoreGapless = minScoreGapless;
   if( args.outputType > 0 ) makeQualityScorers();
 
-  queryAlph.tr( query.seqWriter(),
-                query.seqWriter() + query.unfinishedSize() );
+  alignmentFilter.fromString( args.alignmentFilter );
+  if( alignmentFilter.isUsingEvaluer() && !evaluer.isGood() )
+    ERR( "can't filter on evalue or bitscore: no E-value parameters" );
+
+  if( isMainDatabase )
+    queryAlph.tr( query.seqWriter(),
+		  query.seqWriter() + query.unfinishedSize() );
 
   if( volumes+1 == 0 ) readIndex( args.lastdbName, refSequences );
 
-  std::ostream& out = std::cout;
-  writeHeader( refSequences, refLetters, out );
-  out.precision(3);  // print non-integers more compactly
-  countT queryBatchCount = 0;
-  countT sequenceCount = 0;
+  if( !isMainDatabase && outFileName != "-" ){
+    outFileWriter.open( outFileName );
+    out = &outFileWriter;
+  }
+  std::ostringstream header;
+  writeHeader( refSequences, refLetters, header );
+  out->put( header.str() );
+}
+
+// The queries are read and encoded once, for all the databases
+static void checkSameQueryEncoding( const Database& x, const Database& y ){
+  if( x.queryAlph.letters != y.queryAlph.letters ||
+      x.args.isTranslated() != y.args.isTranslated() ||
+      x.args.inputFormat != y.args.inputFormat ||
+      x.args.isKeepLowercase != y.args.isKeepLowercase )
+    ERR( "can't align the same queries to " + x.args.lastdbName + " and " +
+	 y.args.lastdbName + ": they need the same alphabet, -F, -Q, -R" );
+}
+
+// The writers may still be reading this batch's alignment text from
+// the arenas.  So wait until they have written the previous batch's
+// text, and re-use its arenas for the next batch.
+static void reuseTextArenas( std::vector<Database>& databases ){
+  {
+    PhaseTimer timer( aligners[0].stats, ThreadStats::ioWait );
+    for( size_t d = 0; d < databases.size(); ++d ){
+      OutputWriter& out = *databases[d].out;
+      out.waitUntilWritten( databases[d].previousBatchEnd );
+      databases[d].previousBatchEnd = out.position();
+    }
+  }
+  for( size_t i = 0; i < aligners.size(); ++i ){
+    LastAligner& a = aligners[i];
+    std::swap( a.textArena, a.oldTextArena );
+    a.textArena.clear();
+  }
+}
+
+static void scanBatch( std::vector<Database>& databases,
+		       countT queryBatchNum ){
+  isQueryReversed = false;
+  currentBatchNum = queryBatchNum;
+  for( size_t d = 0; d < databases.size(); ++d )
+    databases[d].scanBatch( queryBatchNum );
+  reuseTextArenas( databases );
+  if( statsFile.isOpen() )
+    statsFile.writeBatch( queryBatchNum, query.finishedSequences(),
+			  totalStats() );
+  writeProgressIfWanted();
+}
+
+struct QueryCounts {
+  countT batches;
+  countT sequences;
+};
+
+// Align the query sequences read so far, if there are any
+static void scanRemainingQueries( std::vector<Database>& databases,
+				  QueryCounts& counts ){
+  if( query.finishedSequences() == 0 ) return;
+  scanBatch( databases, counts.batches++ );
+  query.reinitForAppending();
+}
+
+// Does stdin have more data that we can read without waiting?
+static bool isStdinReady(){
+  if( std::cin.rdbuf()->in_avail() > 0 ) return true;
+  struct pollfd p = { 0, POLLIN, 0 };
+  return poll( &p, 1, 0 ) != 0;
+}
+
+#ifdef HAS_CXX_THREADS
+// Reads query batches into nextQuery in a separate thread, so that
+// reading and encoding the next batch overlaps with aligning (and
+// writing the results of) the current batch in query.  A batch is
+// handed over by swapping the two, and the last sequence of a full
+// batch, if unfinished, is copied back to continue reading it.
+class QueryReader{
+public:
+  QueryReader( std::istream& in, const Database& db, QueryCounts& counts,
+	       bool isStreaming ) :
+    isBatchReady(false), isScanning(false), isDone(false), isStopping(false){
+    nextQuery.swap( query );  // keep appending to the unaligned sequences
+    thread = std::thread( &QueryReader::read, this, std::ref(in),
+			  std::cref(db), std::ref(counts), isStreaming );
+  }
+
+  // Tell the reader thread to stop, and wait for it.  It checks
+  // after each sequence it reads, so it stops soon, even if we are
+  // unwinding from an error in the middle of a batch.  But if it is
+  // blocked in a read (e.g. from a stdin pipe that has no data yet),
+  // this waits until that read returns.
+  ~QueryReader(){
+    {
+      std::lock_guard<std::mutex> lock( mutex );
+      isStopping = true;
+    }
+    isChanged.notify_all();
+    thread.join();
+  }
+
+  // Put the next batch in query, and return true.  Or, if the input
+  // ends first, put the sequences read since the last batch in
+  // query, and return false.
+  bool nextBatch(){
+    // the main thread is thread 0 of the pool, so it uses aligners[0]:
+    PhaseTimer timer( aligners[0].stats, ThreadStats::ioWait );
+    std::unique_lock<std::mutex> lock( mutex );
+    isScanning = false;
+    isChanged.notify_all();
+    while( !isBatchReady && !isDone ) isChanged.wait( lock );
+    if( isBatchReady ){
+      isBatchReady = false;
+      isScanning = true;
+      return true;
+    }
+    if( error ) std::rethrow_exception( error );
+    query.swap( nextQuery );
+    return false;
+  }
+
+private:
+  std::thread thread;
+  std::mutex mutex;
+  std::condition_variable isChanged;
+  bool isBatchReady;  // is there a batch in query, not yet aligned?
+  bool isScanning;  // is the batch in query being aligned?
+  bool isDone;
+  bool isStopping;  // should the reader thread stop?
+  std::exception_ptr error;
+
+  bool isStopRequested(){
+    std::lock_guard<std::mutex> lock( mutex );
+    return isStopping;
+  }
+
+  // Wait until query is free, then hand over nextQuery.  Return
+  // false if we should stop.
+  bool handOver(){
+    std::unique_lock<std::mutex> lock( mutex );
+    while( (isBatchReady || isScanning) && !isStopping ) isChanged.wait( lock );
+    if( isStopping ) return false;
+    query.swap( nextQuery );
+    nextQuery.reinitForAppending( query );
+    isBatchReady = true;
+    isChanged.notify_all();
+    return true;
+  }
+
+  void read( std::istream& in, const Database& db, QueryCounts& counts,
+	     bool isStreaming ){
+    try{
+      while( db.appendFromFasta( nextQuery, in ) ){
+	if( isStopRequested() ) return;
+	if( nextQuery.isFinished() ){
+	  ++counts.sequences;
+	  if( isStreaming && !isStdinReady() && !handOver() ) return;
+	}else{
+	  if( !handOver() ) return;
+	}
+      }
+    }catch( ... ){
+      std::lock_guard<std::mutex> lock( mutex );
+      error = std::current_exception();
+    }
+    std::lock_guard<std::mutex> lock( mutex );
+    isDone = true;
+    isChanged.notify_all();
+  }
+};
+#endif
+
+// Read query sequences, and align each full batch.  If isStreaming,
+// also align whatever we have whenever stdin has no more data ready,
+// so that results appear with bounded delay.
+static void readAndScan( std::istream& in, std::vector<Database>& databases,
+			 QueryCounts& counts, bool isStreaming ){
+#ifdef HAS_CXX_THREADS
+  QueryReader reader( in, databases[0], counts, isStreaming );
+  while( reader.nextBatch() ){
+    scanBatch( databases, counts.batches++ );
+  }
+#else
+  Database& mainDatabase = databases[0];
+  while( mainDatabase.appendFromFasta( query, in ) ){
+    if( query.isFinished() ){
+      ++counts.sequences;
+      if( isStreaming && !isStdinReady() )
+	scanRemainingQueries( databases, counts );
+    }else{
+      scanBatch( databases, counts.batches++ );
+      query.reinitForAppending();
+    }
+  }
+#endif
+}
+
+static void flushAll( std::vector<Database>& databases ){
+  PhaseTimer timer( aligners[0].stats, ThreadStats::ioWait );
+  for( size_t d = 0; d < databases.size(); ++d )
+    databases[d].out->flush();
+}
+
+static bool isSuffix( const std::string& name, const char* suffix ){
+  size_t n = std::strlen( suffix );
+  return name.size() > n && name.compare( name.size() - n, n, suffix ) == 0;
+}
+
+static bool isQueryFileName( std::string name ){
+  if( isSuffix( name, ".gz" ) ) name.resize( name.size() - 3 );
+  else if( isSuffix( name, ".zst" ) ) name.resize( name.size() - 4 );
+  const char* suffixes[] = { ".fa", ".fasta", ".fna", ".fq", ".fastq" };
+  for( size_t i = 0; i < sizeof suffixes / sizeof *suffixes; ++i )
+    if( isSuffix( name, suffixes[i] ) ) return true;
+  return false;
+}
+
+// Get the sizes of query files in a directory, sorted by name
+static void readDirectory( const std::string& dirName,
+			   std::map<std::string, off_t>& fileSizes ){
+  DIR* dir = opendir( dirName.c_str() );
+  if( !dir ) ERR( "can't open directory: " + dirName );
+  fileSizes.clear();
+  while( struct dirent* e = readdir( dir ) ){
+    std::string name = e->d_name;
+    if( name[0] == '.' || !isQueryFileName( name ) ) continue;
+    struct stat s;
+    if( stat( (dirName + "/" + name).c_str(), &s ) == 0 && S_ISREG(s.st_mode) )
+      fileSizes[name] = s.st_size;
+  }
+  closedir( dir );
+}
+
+// Keep aligning new query files as they appear in a directory.  A
+// file is read when its size is unchanged since the previous look.
+// After its results are written, its name is appended (durably) to a
+// record file, so that a restarted lastal won't read it again.  Stop
+// after SIGTERM or SIGINT, or if a file named .lastal-stop appears.
+static void watchDirectory( const std::string& dirName,
+			    std::vector<Database>& databases,
+			    QueryCounts& counts ){
+  const LastalArguments& args = databases[0].args;
+  std::string doneFileName = dirName + "/.lastal-done";
+  std::string stopFileName = dirName + "/.lastal-stop";
+  std::set<std::string> doneFiles;
+  std::ifstream oldDoneFile( doneFileName.c_str() );
+  std::string line;
+  while( getline( oldDoneFile, line ) ) doneFiles.insert( line );
+
+  FILE* doneFile = std::fopen( doneFileName.c_str(), "a" );
+  if( !doneFile ) ERR( "can't open file: " + doneFileName );
+  std::map<std::string, off_t> oldSizes, newSizes;
+
+  struct sigaction sa;
+  sa.sa_handler = requestStop;
+  sigemptyset( &sa.sa_mask );
+  sa.sa_flags = SA_RESTART;  // don't make reads fail with EINTR
+  if( sigaction( SIGTERM, &sa, 0 ) != 0 || sigaction( SIGINT, &sa, 0 ) != 0 )
+    ERR( "can't set SIGTERM/SIGINT handler" );
+
+  while( true ){
+    struct stat s;
+    if( isStopWanted ) break;
+    if( stat( stopFileName.c_str(), &s ) == 0 ){
+      std::remove( stopFileName.c_str() );  // so a new run won't stop
+      break;
+    }
+    readDirectory( dirName, newSizes );
+    for( std::map<std::string, off_t>::const_iterator i = newSizes.begin();
+	 i != newSizes.end() && !isStopWanted; ++i ){
+      const std::string& name = i->first;
+      if( doneFiles.count( name ) ) continue;
+      std::map<std::string, off_t>::const_iterator j = oldSizes.find( name );
+      if( j == oldSizes.end() || j->second != i->second ) continue;
+
+      std::string fileName = dirName + "/" + name;
+      izstream inFileStream;
+      std::istream& in = openIn( fileName, inFileStream, aligners.size() );
+      LOG( "reading " << fileName << "..." );
+      readAndScan( in, databases, counts, false );
+      if( in.bad() ) ERR( "can't read file: " + fileName );
+      scanRemainingQueries( databases, counts );
+      flushAll( databases );
+
+      doneFiles.insert( name );
+      if( std::fprintf( doneFile, "%s\n", name.c_str() ) < 0 ||
+	  std::fflush( doneFile ) != 0 || fsync( fileno( doneFile ) ) != 0 )
+	ERR( "can't write file: " + doneFileName );
+    }
+    oldSizes.swap( newSizes );
+    sleep( 1 );
+  }
+
+  LOG( "stopping" );
+  if( std::fclose( doneFile ) != 0 ) ERR( "can't write file: " + doneFileName );
+}
+
+void lastal( int argc, char** argv ){
+  LastalArguments mainArgs;
+  mainArgs.fromArgs( argc, argv );
+
+  std::vector<Database> databases( 1 + mainArgs.extraDatabases.size() );
+  databases[0].setUp( argc, argv, "" );
+  for( size_t d = 1; d < databases.size(); ++d ){
+    databases[d].setUp( argc, argv, mainArgs.extraDatabases[d - 1] );
+    checkSameQueryEncoding( databases[0], databases[d] );
+  }
+
+  const LastalArguments& args = databases[0].args;
+  QueryCounts counts = { 0, 0 };
+  bool isStreaming = (args.watchDirectory == "-");
+
+  if( !args.statsFile.empty() ){
+    statsFile.open( args.statsFile );
+    for( size_t i = 0; i < aligners.size(); ++i )
+      aligners[i].stats.startTiming();
+    struct sigaction sa;
+    sa.sa_handler = requestProgress;
+    sigemptyset( &sa.sa_mask );
+    sa.sa_flags = SA_RESTART;  // don't make reads fail with EINTR
+    if( sigaction( SIGUSR1, &sa, 0 ) != 0 ) ERR( "can't set SIGUSR1 handler" );
+  }
 
   char defaultInputName[] = "-";
   char* defaultInput[] = { defaultInputName, 0 };
   char** inputBegin = argv + args.inputStart;
+  bool isDefaultInput = !*inputBegin && args.watchDirectory.empty();
 
-  for( char** i = *inputBegin ? inputBegin : defaultInput; *i; ++i ){
-    std::ifstream inFileStream;
-    std::istream& in = openIn( *i, inFileStream );
+  for( char** i = isDefaultInput ? defaultInput : inputBegin; *i; ++i ){
+    izstream inFileStream;
+    std::istream& in = openIn( *i, inFileStream, aligners.size() );
     LOG( "reading " << *i << "..." );
+    readAndScan( in, databases, counts, false );
+  }
 
-    while( appendFromFasta( in ) ){
-      if( query.isFinished() ){
-	++sequenceCount;
-      }else{
-        // this enables downstream parsers to read one batch at a time:
-        out << "# batch " << queryBatchCount++ << "\n";
-	scanAllVolumes( volumes, out );
-	query.reinitForAppending();
-      }
+  if( !args.watchDirectory.empty() ){
+    scanRemainingQueries( databases, counts );
+    flushAll( databases );
+    if( isStreaming ){
+      LOG( "reading stdin..." );
+      readAndScan( std::cin, databases, counts, true );
+    }else{
+      watchDirectory( args.watchDirectory, databases, counts );
     }
   }
 
-  if( query.finishedSequences() > 0 ){
-    out << "# batch " << queryBatchCount << "\n";
-    scanAllVolumes( volumes, out );
-  }
+  scanRemainingQueries( databases, counts );
+
+  for( size_t d = 0; d < databases.size(); ++d )
+    databases[d].out->put( "# Query sequences=" +
+			   stringify( counts.sequences ) + "\n" );
+  flushAll( databases );
 
-  out << "# Query sequences=" << sequenceCount << "\n";
+  if( statsFile.isOpen() )
+    statsFile.writeRun( counts.batches, counts.sequences, totalStats() );
 }
 
 int main( int argc, char** argv )
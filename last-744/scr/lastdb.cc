@@ -12,6 +12,7 @@
 #include "qualityScoreUtil.hh"
 #include "stringify.hh"
 #include "threadUtil.hh"
+#include "zio.hh"
 #include <stdexcept>
 #include <fstream>
 #include <iostream>
@@ -176,6 +177,30 @@ static void preprocessSeqs(MultiSequence &multi,
 #endif
 }
 
+// The maximum bucket depth such that the buckets take at most
+// maxBytes.  Each bucket level has one entry per combination of seed
+// subsets at all the positions up to it.  If every seed position has
+// just one subset, deeper buckets can't split anything, and the levels
+// would only add one entry each, so don't make any.
+static indexT maxBucketDepth( const CyclicSubsetSeed& seed, size_t maxBytes ){
+  unsigned i = 0;
+  while( i < seed.span() && seed.subsetCount( i ) < 2 ) ++i;
+  if( i == seed.span() ) return 0;
+
+  size_t maxEntries = maxBytes / sizeof(indexT);
+  size_t levelEntries = 1;
+  size_t totalEntries = 1;
+  indexT depth = 0;
+  while( true ){
+    size_t s = seed.subsetCount( depth );
+    if( levelEntries > maxEntries / s ) return depth;
+    levelEntries *= s;
+    if( totalEntries > maxEntries - levelEntries ) return depth;
+    totalEntries += levelEntries;
+    ++depth;
+  }
+}
+
 // Make one database volume, from one batch of sequences
 void makeVolume( std::vector< CyclicSubsetSeed >& seeds,
 		 MultiSequence& multi, const LastdbArguments& args,
@@ -211,7 +236,12 @@ void makeVolume( std::vector< CyclicSubsetSeed >& seeds,
     myIndex.sortIndex( seq, args.minSeedLimit, args.childTableType );
 
     LOG( "bucketing..." );
-    myIndex.makeBuckets( seq, args.bucketDepth );
+    indexT bucketDepth = args.bucketDepth;
+    if( bucketDepth + 1 == 0 && args.bucketBytes != size_t(-1) ){
+      bucketDepth = maxBucketDepth( myIndex.getSeed(), args.bucketBytes );
+      LOG( "bucket depth=" << bucketDepth );
+    }
+    myIndex.makeBuckets( seq, bucketDepth );
 
     LOG( "writing..." );
     if( numOfIndexes > 1 ){
@@ -309,8 +339,8 @@ void lastdb( int argc, char** argv ){
   char** inputBegin = argv + args.inputStart;
 
   for( char** i = *inputBegin ? inputBegin : defaultInput; *i; ++i ){
-    std::ifstream inFileStream;
-    std::istream& in = openIn( *i, inFileStream );
+    izstream inFileStream;
+    std::istream& in = openIn( *i, inFileStream, numOfThreads );
     LOG( "reading " << *i << "..." );
 
     while( appendFromFasta( multi, seeds.size(), args, alph, in ) ){
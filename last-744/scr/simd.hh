@@ -0,0 +1,254 @@
+// Copyright 2026 The ARGpore authors
+
+// Thin wrappers for SIMD operations on vectors of 32-bit ints.  If
+// the compiler targets AVX2 or SSE4.1 (e.g. g++ -mavx2 or -msse4),
+// SIMD_LEN is the number of ints per vector, else it is undefined and
+// callers should use plain loops.  The same goes for floating-point
+// vectors, further down.
+
+#ifndef SIMD_HH
+#define SIMD_HH
+
+#if defined __AVX2__
+
+#include <immintrin.h>
+
+#define SIMD_LEN 8
+
+namespace cbrc {
+
+typedef __m256i SimdInt;
+
+static inline SimdInt simdLoad(const int *p) {
+  return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+}
+
+static inline void simdStore(int *p, SimdInt x) {
+  _mm256_storeu_si256(reinterpret_cast<__m256i *>(p), x);
+}
+
+static inline SimdInt simdFill(int x) { return _mm256_set1_epi32(x); }
+
+static inline SimdInt simdIndexes() {
+  return _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+}
+
+static inline SimdInt simdAdd(SimdInt x, SimdInt y) {
+  return _mm256_add_epi32(x, y);
+}
+
+static inline SimdInt simdSub(SimdInt x, SimdInt y) {
+  return _mm256_sub_epi32(x, y);
+}
+
+static inline SimdInt simdMax(SimdInt x, SimdInt y) {
+  return _mm256_max_epi32(x, y);
+}
+
+static inline SimdInt simdGt(SimdInt x, SimdInt y) {
+  return _mm256_cmpgt_epi32(x, y);
+}
+
+// Get y where isY is true, else x
+static inline SimdInt simdBlend(SimdInt x, SimdInt y, SimdInt isY) {
+  return _mm256_blendv_epi8(x, y, isY);
+}
+
+}
+
+#elif defined __SSE4_1__
+
+#include <smmintrin.h>
+
+#define SIMD_LEN 4
+
+namespace cbrc {
+
+typedef __m128i SimdInt;
+
+static inline SimdInt simdLoad(const int *p) {
+  return _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+}
+
+static inline void simdStore(int *p, SimdInt x) {
+  _mm_storeu_si128(reinterpret_cast<__m128i *>(p), x);
+}
+
+static inline SimdInt simdFill(int x) { return _mm_set1_epi32(x); }
+
+static inline SimdInt simdIndexes() { return _mm_setr_epi32(0, 1, 2, 3); }
+
+static inline SimdInt simdAdd(SimdInt x, SimdInt y) {
+  return _mm_add_epi32(x, y);
+}
+
+static inline SimdInt simdSub(SimdInt x, SimdInt y) {
+  return _mm_sub_epi32(x, y);
+}
+
+static inline SimdInt simdMax(SimdInt x, SimdInt y) {
+  return _mm_max_epi32(x, y);
+}
+
+static inline SimdInt simdGt(SimdInt x, SimdInt y) {
+  return _mm_cmpgt_epi32(x, y);
+}
+
+// Get y where isY is true, else x
+static inline SimdInt simdBlend(SimdInt x, SimdInt y, SimdInt isY) {
+  return _mm_blendv_epi8(x, y, isY);
+}
+
+}
+
+#endif
+
+// Vectors of doubles and floats.  If the compiler targets AVX or SSE2,
+// SIMD_DOUBLE_LEN and SIMD_FLOAT_LEN are the numbers per vector.
+
+#if defined __AVX__
+
+#include <immintrin.h>
+
+#define SIMD_DOUBLE_LEN 4
+#define SIMD_FLOAT_LEN 8
+
+namespace cbrc {
+
+typedef __m256d SimdDouble;
+typedef __m256 SimdFloat;
+
+static inline SimdDouble simdLoad(const double *p) {
+  return _mm256_loadu_pd(p);
+}
+
+static inline SimdFloat simdLoad(const float *p) { return _mm256_loadu_ps(p); }
+
+static inline void simdStore(double *p, SimdDouble x) {
+  _mm256_storeu_pd(p, x);
+}
+
+static inline void simdStore(float *p, SimdFloat x) { _mm256_storeu_ps(p, x); }
+
+static inline SimdDouble simdFill(double x) { return _mm256_set1_pd(x); }
+
+static inline SimdFloat simdFill(float x) { return _mm256_set1_ps(x); }
+
+static inline SimdDouble simdAdd(SimdDouble x, SimdDouble y) {
+  return _mm256_add_pd(x, y);
+}
+
+static inline SimdFloat simdAdd(SimdFloat x, SimdFloat y) {
+  return _mm256_add_ps(x, y);
+}
+
+static inline SimdDouble simdSub(SimdDouble x, SimdDouble y) {
+  return _mm256_sub_pd(x, y);
+}
+
+static inline SimdFloat simdSub(SimdFloat x, SimdFloat y) {
+  return _mm256_sub_ps(x, y);
+}
+
+static inline SimdDouble simdMul(SimdDouble x, SimdDouble y) {
+  return _mm256_mul_pd(x, y);
+}
+
+static inline SimdFloat simdMul(SimdFloat x, SimdFloat y) {
+  return _mm256_mul_ps(x, y);
+}
+
+static inline SimdDouble simdMax(SimdDouble x, SimdDouble y) {
+  return _mm256_max_pd(x, y);
+}
+
+static inline SimdFloat simdMax(SimdFloat x, SimdFloat y) {
+  return _mm256_max_ps(x, y);
+}
+
+// The sum of the lanes
+static inline double simdSum(SimdDouble x) {
+  __m128d y = _mm_add_pd(_mm256_castpd256_pd128(x),
+			 _mm256_extractf128_pd(x, 1));
+  return _mm_cvtsd_f64(_mm_add_sd(y, _mm_unpackhi_pd(y, y)));
+}
+
+static inline float simdSum(SimdFloat x) {
+  __m128 y = _mm_add_ps(_mm256_castps256_ps128(x), _mm256_extractf128_ps(x, 1));
+  y = _mm_add_ps(y, _mm_movehl_ps(y, y));
+  return _mm_cvtss_f32(_mm_add_ss(y, _mm_shuffle_ps(y, y, 1)));
+}
+
+}
+
+#elif defined __SSE2__
+
+#include <emmintrin.h>
+
+#define SIMD_DOUBLE_LEN 2
+#define SIMD_FLOAT_LEN 4
+
+namespace cbrc {
+
+typedef __m128d SimdDouble;
+typedef __m128 SimdFloat;
+
+static inline SimdDouble simdLoad(const double *p) { return _mm_loadu_pd(p); }
+
+static inline SimdFloat simdLoad(const float *p) { return _mm_loadu_ps(p); }
+
+static inline void simdStore(double *p, SimdDouble x) { _mm_storeu_pd(p, x); }
+
+static inline void simdStore(float *p, SimdFloat x) { _mm_storeu_ps(p, x); }
+
+static inline SimdDouble simdFill(double x) { return _mm_set1_pd(x); }
+
+static inline SimdFloat simdFill(float x) { return _mm_set1_ps(x); }
+
+static inline SimdDouble simdAdd(SimdDouble x, SimdDouble y) {
+  return _mm_add_pd(x, y);
+}
+
+static inline SimdFloat simdAdd(SimdFloat x, SimdFloat y) {
+  return _mm_add_ps(x, y);
+}
+
+static inline SimdDouble simdSub(SimdDouble x, SimdDouble y) {
+  return _mm_sub_pd(x, y);
+}
+
+static inline SimdFloat simdSub(SimdFloat x, SimdFloat y) {
+  return _mm_sub_ps(x, y);
+}
+
+static inline SimdDouble simdMul(SimdDouble x, SimdDouble y) {
+  return _mm_mul_pd(x, y);
+}
+
+static inline SimdFloat simdMul(SimdFloat x, SimdFloat y) {
+  return _mm_mul_ps(x, y);
+}
+
+static inline SimdDouble simdMax(SimdDouble x, SimdDouble y) {
+  return _mm_max_pd(x, y);
+}
+
+static inline SimdFloat simdMax(SimdFloat x, SimdFloat y) {
+  return _mm_max_ps(x, y);
+}
+
+// The sum of the lanes
+static inline double simdSum(SimdDouble x) {
+  return _mm_cvtsd_f64(_mm_add_sd(x, _mm_unpackhi_pd(x, x)));
+}
+
+static inline float simdSum(SimdFloat x) {
+  SimdFloat y = _mm_add_ps(x, _mm_movehl_ps(x, x));
+  return _mm_cvtss_f32(_mm_add_ss(y, _mm_shuffle_ps(y, y, 1)));
+}
+
+}
+
+#endif
+
+#endif
@@ -0,0 +1,343 @@
+// Copyright 2026 The ARGpore authors
+
+#include "zio.hh"
+
+#include <zlib.h>
+#ifdef HAS_ZSTD
+#include <zstd.h>
+#endif
+
+#include <string.h>
+#include <algorithm>  // min
+#include <iostream>
+#include <stdexcept>
+
+#define ERR(x) throw std::runtime_error(x)
+
+namespace cbrc{
+
+enum { inSize = 1 << 20,  // bytes of compressed data to read at once
+       outSize = 1 << 20,  // bytes of decompressed data per chunk
+       maxChunks = 4,  // decompressed chunks to hold, waiting to be read
+       bgzfHeaderSize = 18,
+       bgzfFooterSize = 8,
+       maxBgzfInflatedSize = 65536,  // the BGZF spec's limit per block
+       blocksPerThread = 16 };
+
+static unsigned get16(const char *s) {
+  const unsigned char *u = reinterpret_cast<const unsigned char *>(s);
+  return u[0] | (u[1] << 8);
+}
+
+static unsigned long get32(const char *s) {
+  return get16(s) | (static_cast<unsigned long>(get16(s + 2)) << 16);
+}
+
+static bool isBgzfHeader(const char *s) {
+  return s[0] == '\x1f' && s[1] == '\x8b' && s[3] == 4 &&
+    get16(s + 10) == 6 && s[12] == 'B' && s[13] == 'C' && get16(s + 14) == 2;
+}
+
+void DecompressingBuffer::open(const std::string &fileName,
+			       unsigned numOfThreads) {
+  close();
+  this->fileName = fileName;
+  this->numOfThreads = numOfThreads ? numOfThreads : 1;
+  file = fopen(fileName.c_str(), "rb");
+  if (!file) ERR("can't open file: " + fileName);
+
+  inBuf.resize(inSize);
+  inBeg = inEnd = 0;
+  readInput(bgzfHeaderSize);
+  const char *s = &inBuf[0];
+  size_t n = inEnd;
+  isStreamEnd = false;
+
+  if (n >= 2 && s[0] == '\x1f' && s[1] == '\x8b') {
+    format = (n >= bgzfHeaderSize && isBgzfHeader(s) && this->numOfThreads > 1)
+      ? bgzf : gzip;
+    if (format == gzip) {
+      z_stream *z = new z_stream;
+      memset(z, 0, sizeof *z);
+      if (inflateInit2(z, 15 + 16) != Z_OK) {
+	delete z;
+	ERR("can't decompress file: " + fileName);
+      }
+      stream = z;
+    }
+  } else if (n >= 4 && get32(s) == 0xFD2FB528UL) {
+    format = zstd;
+#ifdef HAS_ZSTD
+    ZSTD_DStream *z = ZSTD_createDStream();
+    if (!z) ERR("can't decompress file: " + fileName);
+    stream = z;
+    if (ZSTD_isError(ZSTD_initDStream(z)))
+      ERR("can't decompress file: " + fileName);
+#else
+    ERR("can't read zstd-compressed file (not compiled with HAS_ZSTD): " +
+	fileName);
+#endif
+  } else {
+    format = plain;
+  }
+
+#ifdef HAS_CXX_THREADS
+  isDone = false;
+  isStopping = false;
+  error.clear();
+  producer = std::thread(&DecompressingBuffer::produce, this);
+#endif
+}
+
+void DecompressingBuffer::close() {
+#ifdef HAS_CXX_THREADS
+  if (producer.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      isStopping = true;
+    }
+    isChanged.notify_all();
+    producer.join();
+  }
+  chunks.clear();
+#endif
+  if (stream) {
+    if (format == gzip) {
+      z_stream *z = static_cast<z_stream *>(stream);
+      inflateEnd(z);
+      delete z;
+    }
+#ifdef HAS_ZSTD
+    if (format == zstd) ZSTD_freeDStream(static_cast<ZSTD_DStream *>(stream));
+#endif
+    stream = 0;
+  }
+  if (file) fclose(file);
+  file = 0;
+  current.clear();
+  setg(0, 0, 0);
+}
+
+DecompressingBuffer::int_type DecompressingBuffer::underflow() {
+  if (gptr() < egptr()) return traits_type::to_int_type(*gptr());
+  if (!getChunk(current)) return traits_type::eof();
+  char *b = &current[0];
+  setg(b, b, b + current.size());
+  return traits_type::to_int_type(*b);
+}
+
+#ifdef HAS_CXX_THREADS
+void DecompressingBuffer::produce() {
+  std::vector<char> out;
+  try {
+    while (decompress(out)) {
+      std::unique_lock<std::mutex> lock(mutex);
+      while (chunks.size() >= maxChunks && !isStopping) isChanged.wait(lock);
+      if (isStopping) return;
+      chunks.push_back(std::vector<char>());
+      chunks.back().swap(out);
+      isChanged.notify_all();
+    }
+  } catch (const std::exception &e) {
+    std::lock_guard<std::mutex> lock(mutex);
+    error = e.what();
+  }
+  std::lock_guard<std::mutex> lock(mutex);
+  isDone = true;
+  isChanged.notify_all();
+}
+
+bool DecompressingBuffer::getChunk(std::vector<char> &out) {
+  std::unique_lock<std::mutex> lock(mutex);
+  while (chunks.empty() && !isDone) isChanged.wait(lock);
+  if (chunks.empty()) {
+    if (!error.empty()) ERR(error);
+    return false;
+  }
+  out.swap(chunks.front());
+  chunks.pop_front();
+  isChanged.notify_all();
+  return true;
+}
+#else
+bool DecompressingBuffer::getChunk(std::vector<char> &out) {
+  return decompress(out);
+}
+#endif
+
+bool DecompressingBuffer::decompress(std::vector<char> &out) {
+  switch (format) {
+  case plain: return readPlain(out);
+  case gzip:  return inflateGzip(out);
+  case bgzf:  return inflateBgzf(out);
+  case zstd:  return decompressZstd(out);
+  }
+  return false;
+}
+
+// Make sure at least minSize bytes are buffered, if the file has that
+// many more, and return the number buffered
+size_t DecompressingBuffer::readInput(size_t minSize) {
+  if (inEnd - inBeg >= minSize) return inEnd - inBeg;
+  memmove(&inBuf[0], &inBuf[inBeg], inEnd - inBeg);
+  inEnd -= inBeg;
+  inBeg = 0;
+  if (inBuf.size() < minSize) inBuf.resize(minSize);
+  while (inEnd < minSize) {
+    size_t n = fread(&inBuf[inEnd], 1, inBuf.size() - inEnd, file);
+    inEnd += n;
+    if (n == 0) {
+      if (ferror(file)) ERR("can't read file: " + fileName);
+      break;
+    }
+  }
+  return inEnd;
+}
+
+bool DecompressingBuffer::readPlain(std::vector<char> &out) {
+  out.resize(outSize);
+  size_t n = std::min(readInput(1), out.size());
+  memcpy(&out[0], &inBuf[inBeg], n);
+  inBeg += n;
+  out.resize(n);
+  return n > 0;
+}
+
+// This handles files with several gzip members, such as BGZF
+bool DecompressingBuffer::inflateGzip(std::vector<char> &out) {
+  z_stream *z = static_cast<z_stream *>(stream);
+  out.resize(outSize);
+  z->next_out = reinterpret_cast<Bytef *>(&out[0]);
+  z->avail_out = out.size();
+  while (z->avail_out > 0) {
+    size_t n = readInput(1);
+    if (n == 0) {
+      if (!isStreamEnd) ERR("unexpected end of compressed file: " + fileName);
+      break;
+    }
+    if (isStreamEnd) {
+      inflateReset(z);
+      isStreamEnd = false;
+    }
+    z->next_in = reinterpret_cast<Bytef *>(&inBuf[inBeg]);
+    z->avail_in = n;
+    int r = inflate(z, Z_NO_FLUSH);
+    inBeg = inEnd - z->avail_in;
+    if (r == Z_STREAM_END) isStreamEnd = true;
+    else if (r != Z_OK) ERR("bad compressed data in file: " + fileName);
+  }
+  out.resize(out.size() - z->avail_out);
+  return !out.empty();
+}
+
+void DecompressingBuffer::inflateSomeBlocks(char *out,
+					    size_t firstBlock, size_t step,
+					    std::string *err) {
+  z_stream z;
+  memset(&z, 0, sizeof z);
+  if (inflateInit2(&z, -15) != Z_OK) {
+    *err = "can't decompress file: " + fileName;
+    return;
+  }
+  for (size_t i = firstBlock; i + 1 < blockBegs.size(); i += step) {
+    char *b = &blocks[0] + blockBegs[i];
+    char *e = &blocks[0] + blockBegs[i + 1];
+    size_t outLen = outBegs[i + 1] - outBegs[i];
+    Bytef *o = reinterpret_cast<Bytef *>(out + outBegs[i]);
+    inflateReset(&z);
+    z.next_in = reinterpret_cast<Bytef *>(b + bgzfHeaderSize);
+    z.avail_in = e - b - bgzfHeaderSize - bgzfFooterSize;
+    z.next_out = o;
+    z.avail_out = outLen;
+    if (inflate(&z, Z_FINISH) != Z_STREAM_END || z.avail_out > 0 ||
+	crc32(crc32(0, 0, 0), o, outLen) != get32(e - bgzfFooterSize)) {
+      *err = "bad compressed data in file: " + fileName;
+      break;
+    }
+  }
+  inflateEnd(&z);
+}
+
+// Read several BGZF blocks, and inflate them in parallel
+bool DecompressingBuffer::inflateBgzf(std::vector<char> &out) {
+  blocks.clear();
+  blockBegs.assign(1, 0);
+  outBegs.assign(1, 0);
+  size_t maxBlocks = numOfThreads * blocksPerThread;
+
+  while (blockBegs.size() <= maxBlocks) {
+    size_t n = readInput(bgzfHeaderSize);
+    if (n == 0) break;
+    const char *h = &inBuf[inBeg];
+    if (n < bgzfHeaderSize || !isBgzfHeader(h))
+      ERR("bad BGZF data in file: " + fileName);
+    size_t blockSize = get16(h + 16) + 1;
+    if (blockSize < bgzfHeaderSize + bgzfFooterSize ||
+	readInput(blockSize) < blockSize)
+      ERR("bad BGZF data in file: " + fileName);
+    h = &inBuf[inBeg];
+    size_t inflatedSize = get32(h + blockSize - 4);
+    if (inflatedSize > maxBgzfInflatedSize)  // don't trust it before the CRC
+      ERR("bad BGZF data in file: " + fileName);
+    blocks.insert(blocks.end(), h, h + blockSize);
+    inBeg += blockSize;
+    blockBegs.push_back(blocks.size());
+    outBegs.push_back(outBegs.back() + inflatedSize);
+  }
+
+  size_t numOfBlocks = blockBegs.size() - 1;
+  if (numOfBlocks == 0) return false;
+  out.resize(outBegs.back());
+  if (out.empty()) return inflateBgzf(out);  // skip empty blocks
+
+  size_t numOfWorkers = std::min<size_t>(numOfThreads, numOfBlocks);
+  std::vector<std::string> errors(numOfWorkers);
+#ifdef HAS_CXX_THREADS
+  std::vector<std::thread> workers;
+  for (size_t i = 1; i < numOfWorkers; ++i)
+    workers.push_back(std::thread(&DecompressingBuffer::inflateSomeBlocks,
+				  this, &out[0], i, numOfWorkers, &errors[i]));
+#endif
+  inflateSomeBlocks(&out[0], 0, numOfWorkers, &errors[0]);
+#ifdef HAS_CXX_THREADS
+  for (size_t i = 0; i < workers.size(); ++i) workers[i].join();
+#endif
+  for (size_t i = 0; i < numOfWorkers; ++i)
+    if (!errors[i].empty()) ERR(errors[i]);
+
+  return true;
+}
+
+bool DecompressingBuffer::decompressZstd(std::vector<char> &out) {
+#ifdef HAS_ZSTD
+  ZSTD_DStream *z = static_cast<ZSTD_DStream *>(stream);
+  out.resize(outSize);
+  ZSTD_outBuffer o = { &out[0], out.size(), 0 };
+  while (o.pos < o.size) {
+    size_t n = readInput(1);
+    if (n == 0) {
+      if (!isStreamEnd) ERR("unexpected end of compressed file: " + fileName);
+      break;
+    }
+    ZSTD_inBuffer i = { &inBuf[inBeg], n, 0 };
+    size_t r = ZSTD_decompressStream(z, &o, &i);
+    if (ZSTD_isError(r)) ERR("bad compressed data in file: " + fileName);
+    inBeg += i.pos;
+    isStreamEnd = (r == 0);
+  }
+  out.resize(o.pos);
+  return !out.empty();
+#else
+  out.clear();
+  return false;
+#endif
+}
+
+std::istream &openIn(const std::string &fileName, izstream &z,
+		     unsigned numOfThreads) {
+  if (fileName == "-") return std::cin;
+  z.open(fileName, numOfThreads);
+  return z;
+}
+
+}  // end namespace cbrc
@@ -0,0 +1,104 @@
+// Copyright 2026 The ARGpore authors
+
+// An input stream for files that may be compressed with gzip, BGZF,
+// or zstd (or not compressed).  The decompression runs ahead of the
+// reader in its own thread, and BGZF blocks are inflated by several
+// threads, so the reader only waits if decompression is slower.
+
+#ifndef ZIO_HH
+#define ZIO_HH
+
+#include <stdio.h>
+#include <deque>
+#include <istream>
+#include <string>
+#include <vector>
+
+#ifdef HAS_CXX_THREADS
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#endif
+
+namespace cbrc{
+
+class DecompressingBuffer : public std::streambuf {
+public:
+  DecompressingBuffer() : file(0), stream(0) {}
+  ~DecompressingBuffer() { close(); }
+
+  // Throw runtime_error if the file can't be opened.  numOfThreads
+  // is the number of threads for inflating BGZF blocks.
+  void open(const std::string &fileName, unsigned numOfThreads);
+
+  void close();
+
+protected:
+  int_type underflow();
+
+private:
+  enum Format { plain, gzip, bgzf, zstd };
+
+  std::string fileName;
+  FILE *file;
+  Format format;
+  unsigned numOfThreads;
+  void *stream;  // zlib or zstd decompression state
+  bool isStreamEnd;
+
+  std::vector<char> inBuf;  // compressed data
+  size_t inBeg;
+  size_t inEnd;
+
+  std::vector<char> current;  // decompressed data being read
+
+  std::vector<char> blocks;  // BGZF blocks to inflate together
+  std::vector<size_t> blockBegs;  // start of each block in blocks
+  std::vector<size_t> outBegs;  // start of each block's output
+
+#ifdef HAS_CXX_THREADS
+  std::thread producer;
+  std::mutex mutex;
+  std::condition_variable isChanged;
+  std::deque< std::vector<char> > chunks;  // decompressed, not yet read
+  bool isDone;
+  bool isStopping;
+  std::string error;
+
+  void produce();
+#endif
+
+  // Get the next piece of decompressed data, or return false at the end
+  bool decompress(std::vector<char> &out);
+  bool getChunk(std::vector<char> &out);
+
+  size_t readInput(size_t minSize);
+  bool readPlain(std::vector<char> &out);
+  bool inflateGzip(std::vector<char> &out);
+  bool inflateBgzf(std::vector<char> &out);
+  bool decompressZstd(std::vector<char> &out);
+  void inflateSomeBlocks(char *out, size_t firstBlock, size_t step,
+			 std::string *err);
+};
+
+class izstream : public std::istream {
+public:
+  izstream() : std::istream(&buf) { exceptions(std::ios::badbit); }
+
+  void open(const std::string &fileName, unsigned numOfThreads) {
+    buf.open(fileName, numOfThreads);
+  }
+
+  void close() { buf.close(); }
+
+private:
+  DecompressingBuffer buf;
+};
+
+// open an input file, which may be compressed, but if the name is
+// "-", just return cin
+std::istream &openIn(const std::string &fileName, izstream &z,
+		     unsigned numOfThreads);
+
+}  // end namespace cbrc
+#endif  // ZIO_HH